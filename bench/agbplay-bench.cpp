@@ -0,0 +1,252 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+// sorry, for some reason multiple versions of jsoncpp use different paths :/
+#if __has_include(<json/json.h>)
+#include <json/json.h>
+#include <json/writer.h>
+#else
+#include <jsoncpp/json/json.h>
+#include <jsoncpp/json/writer.h>
+#endif
+
+#include "ExportCLI.h"
+#include "SoundData.h"
+#include "PlayerContext.h"
+#include "LoudnessCalculator.h"
+#include "ConfigManager.h"
+#include "Profiler.h"
+#include "Constants.h"
+#include "Debug.h"
+#include "Xcept.h"
+#include "Rom.h"
+
+/*
+ * Renders songs of a ROM several times and reports how long each stage of the
+ * engine took, as JSON on stdout. All times are microseconds per second of
+ * rendered audio, with percentiles over blocks of one second. Rendering is
+ * single threaded and nothing is written, so the numbers are comparable
+ * across commits on the same machine.
+ */
+
+static void usage()
+{
+    std::cout << "Usage: ./agbplay-bench <ROM.gba> [table number] [options]\n"
+        "  --songs <list>: Songs to render, e.g. \"1,5-20\" (default: all songs)\n"
+        "  --iterations <N>: How often each song is rendered (default: 3)\n"
+        "  --warmup <N>: Iterations which aren't measured (default: 1)\n"
+        "  --samplerate <Hz>: Output sample rate\n" << std::flush;
+}
+
+struct StageSamples
+{
+    std::vector<double> blocks;     // us per second of audio, one entry per block
+    double totalUs = 0.0;
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    // nearest rank
+    size_t rank = static_cast<size_t>(p / 100.0 * double(sorted.size()) + 0.5);
+    rank = std::clamp<size_t>(rank, 1, sorted.size());
+    return sorted[rank - 1];
+}
+
+static Json::Value stageJson(StageSamples& stage)
+{
+    std::sort(stage.blocks.begin(), stage.blocks.end());
+    double sum = 0.0;
+    for (double b : stage.blocks)
+        sum += b;
+
+    Json::Value json;
+    json["total-ms"] = stage.totalUs / 1000.0;
+    json["mean"] = stage.blocks.empty() ? 0.0 : sum / double(stage.blocks.size());
+    json["p50"] = percentile(stage.blocks, 50.0);
+    json["p90"] = percentile(stage.blocks, 90.0);
+    json["p99"] = percentile(stage.blocks, 99.0);
+    json["max"] = stage.blocks.empty() ? 0.0 : stage.blocks.back();
+    return json;
+}
+
+static int run(int argc, char *argv[])
+{
+    std::string romPath;
+    size_t songTableIndex = 0;
+    bool songTableGiven = false;
+    std::vector<uint16_t> songs;
+    size_t iterations = 3;
+    size_t warmup = 1;
+    uint32_t sampleRate = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp("--songs", argv[i]) && hasValue) {
+            songs = ExportCLI::ParseSongList(argv[++i]);
+        } else if (!strcmp("--iterations", argv[i]) && hasValue) {
+            iterations = std::max<size_t>(1, ExportCLI::ParseNumber(argv[i], argv[i + 1]));
+            i++;
+        } else if (!strcmp("--warmup", argv[i]) && hasValue) {
+            warmup = ExportCLI::ParseNumber(argv[i], argv[i + 1]);
+            i++;
+        } else if (!strcmp("--samplerate", argv[i]) && hasValue) {
+            sampleRate = static_cast<uint32_t>(ExportCLI::ParseNumber(argv[i], argv[i + 1]));
+            if (sampleRate < STREAM_SAMPLERATE_MIN || sampleRate > STREAM_SAMPLERATE_MAX)
+                throw Xcept("--samplerate: %u Hz is out of range", sampleRate);
+            i++;
+        } else if (!strcmp("-h", argv[i]) || !strcmp("--help", argv[i])) {
+            usage();
+            return EXIT_SUCCESS;
+        } else if (argv[i][0] != '-' && romPath.empty()) {
+            romPath = argv[i];
+        } else if (argv[i][0] != '-' && !songTableGiven) {
+            songTableIndex = ExportCLI::ParseNumber("table number", argv[i]);
+            songTableGiven = true;
+        } else {
+            throw Xcept("Invalid argument: %s", argv[i]);
+        }
+    }
+    if (romPath.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    Debug::set_callback([](const std::string& msg, void *) {
+        std::cerr << msg << std::endl;
+    }, nullptr);
+
+    Rom::CreateInstance(romPath.c_str());
+    ConfigManager& cm = ConfigManager::Instance();
+    cm.Load();
+    if (sampleRate != 0)
+        cm.OverrideSampleRate(sampleRate);
+    sampleRate = cm.GetSampleRate();
+
+    std::vector<SongTable> songTables = SongTable::ScanForTables();
+    if (songTableIndex >= songTables.size())
+        throw Xcept("Songtable index out of range");
+    std::ostringstream gameCode;
+    gameCode << Rom::Instance().GetROMCode();
+    if (songTableIndex > 0)
+        gameCode << ":" << songTableIndex;
+    cm.SetGameCode(gameCode.str());
+    SongTable& songTable = songTables[songTableIndex];
+
+    if (songs.empty()) {
+        for (size_t i = 0; i < songTable.GetNumSongs(); i++)
+            songs.push_back(static_cast<uint16_t>(i));
+    }
+
+    GameConfig& cfg = cm.GetCfg();
+    const size_t numStages = static_cast<size_t>(ProfileStage::COUNT);
+    std::vector<StageSamples> stages(numStages);
+    StageSamples total;
+    std::vector<double> songSeconds(songs.size(), 0.0);
+    size_t samplesRendered = 0;
+
+    std::vector<std::vector<sample>> trackAudio;
+    std::vector<sample> masterAudio;
+    for (size_t iteration = 0; iteration < warmup + iterations; iteration++) {
+        const bool measure = iteration >= warmup;
+        for (size_t s = 0; s < songs.size(); s++) {
+            if (songs[s] >= songTable.GetNumSongs())
+                throw Xcept("Song %u doesn't exist, the songtable only has %zu songs", songs[s], songTable.GetNumSongs());
+
+            PlayerContext ctx(
+                    cm.GetMaxLoopsExport(),
+                    cfg.GetTrackLimit(),
+                    EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq()),
+                    sampleRate
+                    );
+            ctx.InitSong(songTable.GetPosOfSong(songs[s]));
+            LoudnessCalculator loudness(5.0f, sampleRate);
+            Profiler::TakeTotals();
+
+            do {
+                auto blockStart = std::chrono::steady_clock::now();
+                // one second per block, like the exporter
+                size_t n = ctx.Render(trackAudio, AGB_FPS * INTERFRAMES);
+                masterAudio.assign(n, sample{0.0f, 0.0f});
+                for (const std::vector<sample>& b : trackAudio) {
+                    for (size_t i = 0; i < n; i++) {
+                        masterAudio[i].left += b[i].left;
+                        masterAudio[i].right += b[i].right;
+                    }
+                }
+                loudness.CalcLoudness(masterAudio.data(), n);
+                auto blockEnd = std::chrono::steady_clock::now();
+                Profiler::Totals totals = Profiler::TakeTotals();
+
+                // the last block of a song may be very short, don't let it skew the per second values
+                if (!measure || n < sampleRate / 4)
+                    continue;
+                const double blockUs = std::chrono::duration<double, std::micro>(blockEnd - blockStart).count();
+                const double perSecond = double(sampleRate) / double(n);
+                for (size_t i = 0; i < numStages; i++) {
+                    stages[i].blocks.push_back(double(totals[i]) / 1000.0 * perSecond);
+                    stages[i].totalUs += double(totals[i]) / 1000.0;
+                }
+                total.blocks.push_back(blockUs * perSecond);
+                total.totalUs += blockUs;
+                songSeconds[s] += blockUs / 1e6;
+                samplesRendered += n;
+            } while (!ctx.HasEnded());
+        }
+    }
+
+    Json::Value root;
+    root["rom"] = romPath;
+    root["table"] = static_cast<Json::UInt64>(songTableIndex);
+    root["samplerate"] = sampleRate;
+    root["iterations"] = static_cast<Json::UInt64>(iterations);
+    root["warmup"] = static_cast<Json::UInt64>(warmup);
+    root["blocks"] = static_cast<Json::UInt64>(total.blocks.size());
+    root["audio-seconds"] = double(samplesRendered) / double(sampleRate);
+#ifdef AGBPLAY_PROFILE
+    root["profiled"] = true;
+#else
+    root["profiled"] = false;   // only the totals are measured
+#endif
+    root["unit"] = "us per second of audio";
+
+    Json::Value stagesJson;
+    for (size_t i = 0; i < numStages; i++)
+        stagesJson[Profiler::GetStageName(static_cast<ProfileStage>(i))] = stageJson(stages[i]);
+    root["stages"] = stagesJson;
+    root["total"] = stageJson(total);
+
+    Json::Value songsJson(Json::arrayValue);
+    for (size_t s = 0; s < songs.size(); s++) {
+        Json::Value songJson;
+        songJson["index"] = songs[s];
+        songJson["seconds"] = songSeconds[s] / double(iterations);
+        songsJson.append(songJson);
+    }
+    root["songs"] = songsJson;
+
+    Json::StreamWriterBuilder builder;
+    builder["commentStyle"] = "None";
+    builder["indentation"] = "  ";
+    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    writer->write(root, &std::cout);
+    std::cout << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        return run(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -375,7 +375,7 @@ void CGBChannel::applyVol()
  * public SquareChannel
  */
 
-SquareChannel::SquareChannel(WaveDuty wd, ADSR env, Note note, uint8_t sweep)
+SquareChannel::SquareChannel(ResamplerPool& rsPool, WaveDuty wd, ADSR env, Note note, uint8_t sweep)
     : CGBChannel(env, note)
       , sweep(sweep)
       , sweepEnabled(isSweepEnabled(sweep))
@@ -390,7 +390,7 @@ SquareChannel::SquareChannel(WaveDuty wd, ADSR env, Note note, uint8_t sweep)
     };
 
     this->pat = patterns[static_cast<int>(wd)];
-    this->rs = std::make_unique<BlepResampler>();
+    this->rs = rsPool.Get(ResamplerType::BLEP);
 }
 
 void SquareChannel::SetPitch(int16_t pitch)
@@ -439,7 +439,9 @@ void SquareChannel::Process(sample *buffer, size_t numSamples, MixingArgs& args)
 
     float outBuffer[numSamples];
 
-    rs->Process(outBuffer, numSamples, interStep, sampleFetchCallback, this);
+    // rs is always a BlepResampler, so the fetch can be inlined
+    StaticFetchSource<sampleFetchCallback> src{this};
+    static_cast<BlepResampler&>(*rs).ProcessT(outBuffer, numSamples, interStep, src);
 
     size_t i = 0;
     do {
@@ -467,14 +469,10 @@ void SquareChannel::Process(sample *buffer, size_t numSamples, MixingArgs& args)
     }
 }
 
-bool SquareChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata)
+bool SquareChannel::sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata)
 {
-    if (fetchBuffer.size() >= samplesRequired)
-        return true;
     SquareChannel *_this = static_cast<SquareChannel *>(cbdata);
-    size_t samplesToFetch = samplesRequired - fetchBuffer.size();
-    size_t i = fetchBuffer.size();
-    fetchBuffer.resize(samplesRequired);
+    size_t i = 0;
 
     do {
         fetchBuffer[i++] = _this->pat[_this->pos++];
@@ -552,10 +550,10 @@ uint8_t SquareChannel::sweepTime(uint8_t sweep)
  * public WaveChannel
  */
 
-WaveChannel::WaveChannel(const uint8_t *wavePtr, ADSR env, Note note, bool useStairstep)
+WaveChannel::WaveChannel(ResamplerPool& rsPool, const uint8_t *wavePtr, ADSR env, Note note, bool useStairstep)
     : CGBChannel(env, note, useStairstep), wavePtr(wavePtr)
 {
-    this->rs = std::make_unique<BlepResampler>();
+    this->rs = rsPool.Get(ResamplerType::BLEP);
 
     /* wave samples are unsigned by default, so we'll calculate the required
      * DC offset correction */
@@ -633,7 +631,9 @@ void WaveChannel::Process(sample *buffer, size_t numSamples, MixingArgs& args)
 
     float outBuffer[numSamples];
 
-    rs->Process(outBuffer, numSamples, interStep, sampleFetchCallback, this);
+    // rs is always a BlepResampler, so the fetch can be inlined
+    StaticFetchSource<sampleFetchCallback> src{this};
+    static_cast<BlepResampler&>(*rs).ProcessT(outBuffer, numSamples, interStep, src);
 
     size_t i = 0;
     do {
@@ -681,14 +681,10 @@ VolumeFade WaveChannel::getVol() const
     return retval;
 }
 
-bool WaveChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata)
+bool WaveChannel::sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata)
 {
-    if (fetchBuffer.size() >= samplesRequired)
-        return true;
     WaveChannel *_this = static_cast<WaveChannel *>(cbdata);
-    size_t samplesToFetch = samplesRequired - fetchBuffer.size();
-    size_t i = fetchBuffer.size();
-    fetchBuffer.resize(samplesRequired);
+    size_t i = 0;
 
     GameConfig& cfg = ConfigManager::Instance().GetCfg();
 
@@ -765,10 +761,11 @@ bool WaveChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t sa
  * public NoiseChannel
  */
 
-NoiseChannel::NoiseChannel(NoisePatt np, ADSR env, Note note)
+NoiseChannel::NoiseChannel(ResamplerPool& rsPool, NoisePatt np, ADSR env, Note note)
     : CGBChannel(env, note)
 {
-    this->rs = std::make_unique<NearestResampler>();
+    this->rs = rsPool.Get(ResamplerType::NEAREST);
+    this->srs = rsPool.Get(ResamplerType::SINC);
     if (np == NoisePatt::FINE) {
         noiseState = 0x4000;
         noiseLfsrMask = 0x6000;
@@ -811,15 +808,13 @@ void NoiseChannel::Process(sample *buffer, size_t numSamples, MixingArgs& args)
 
     float outBuffer[numSamples];
 
-    Resampler::ResamplerChainData rcd;
-    rcd._this = rs.get();
-    rcd.phaseInc = interStep;
-    rcd.cbPtr = sampleFetchCallback;
-    rcd.cbdata = this;
+    // the LFSR output is first sampled at a fixed rate and then resampled to the output rate
+    StaticFetchSource<sampleFetchCallback> src{this};
+    ResamplerChainSource<NearestResampler, decltype(src)> chainSrc{
+        static_cast<NearestResampler&>(*rs), interStep, src};
 
-    srs.Process(outBuffer, numSamples,
-            NOISE_SAMPLING_FREQ / float(STREAM_SAMPLERATE),
-            Resampler::ResamplerChainSampleFetchCB, &rcd);
+    static_cast<SincResampler&>(*srs).ProcessT(outBuffer, numSamples,
+            NOISE_SAMPLING_FREQ * args.sampleRateInv, chainSrc);
 
     size_t i = 0;
     do {
@@ -832,14 +827,10 @@ void NoiseChannel::Process(sample *buffer, size_t numSamples, MixingArgs& args)
     } while (--numSamples > 0);
 }
 
-bool NoiseChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata)
+bool NoiseChannel::sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata)
 {
-    if (fetchBuffer.size() >= samplesRequired)
-        return true;
     NoiseChannel *_this = static_cast<NoiseChannel *>(cbdata);
-    size_t samplesToFetch = samplesRequired - fetchBuffer.size();
-    size_t i = fetchBuffer.size();
-    fetchBuffer.resize(samplesRequired);
+    size_t i = 0;
 
     do {
         float sample;
@@ -40,7 +40,7 @@ protected:
     static float timer2freq(float timer);
     static float freq2timer(float freq);
 
-    std::unique_ptr<Resampler> rs;
+    ResamplerPool::Ptr rs;
     enum class Pan { LEFT, CENTER, RIGHT };
     uint32_t pos = 0;
     float freq = 0.0f;
@@ -69,12 +69,12 @@ protected:
 class SquareChannel : public CGBChannel
 {
 public:
-    SquareChannel(WaveDuty wd, ADSR env, Note note, uint8_t sweep);
+    SquareChannel(ResamplerPool& rsPool, WaveDuty wd, ADSR env, Note note, uint8_t sweep);
 
     void SetPitch(int16_t pitch) override;
     void Process(sample *buffer, size_t numSamples, MixingArgs& args) override;
 private:
-    static bool sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata);
+    static bool sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata);
 
     static bool isSweepEnabled(uint8_t sweep);
     static bool isSweepAscending(uint8_t sweep);
@@ -95,14 +95,14 @@ private:
 class WaveChannel : public CGBChannel
 {
 public:
-    WaveChannel(const uint8_t *wavePtr, ADSR env, Note note, bool useStairstep);
+    WaveChannel(ResamplerPool& rsPool, const uint8_t *wavePtr, ADSR env, Note note, bool useStairstep);
 
     void SetPitch(int16_t pitch) override;
     void Process(sample *buffer, size_t numSamples, MixingArgs& args) override;
 private:
     bool IsChn3() const override;
     VolumeFade getVol() const;
-    static bool sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata);
+    static bool sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata);
     float dcCorrection100;
     float dcCorrection75;
     float dcCorrection50;
@@ -113,13 +113,13 @@ private:
 class NoiseChannel : public CGBChannel
 {
 public:
-    NoiseChannel(NoisePatt np, ADSR env, Note note);
+    NoiseChannel(ResamplerPool& rsPool, NoisePatt np, ADSR env, Note note);
 
     void SetPitch(int16_t pitch) override;
     void Process(sample *buffer, size_t numSamples, MixingArgs& args) override;
 private:
-    static bool sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata);
-    SincResampler srs;
+    static bool sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata);
+    ResamplerPool::Ptr srs;
     uint16_t noiseState;
     uint16_t noiseLfsrMask;
 };
@@ -18,6 +18,7 @@
 #include "Xcept.h"
 #include "Debug.h"
 #include "OS.h"
+#include "Constants.h"
 
 ConfigManager& ConfigManager::Instance()
 {
@@ -98,6 +99,22 @@ void ConfigManager::Load()
     padSecondsStart = root.get("pad-seconds-start", 0.0).asDouble();
     padSecondsEnd = root.get("pad-seconds-end", 0.0).asDouble();
 
+    // Output configuration, a playback buffer size of 0 selects a size based on the sample rate
+    sampleRate = std::clamp<uint32_t>(root.get("output-samplerate", STREAM_SAMPLERATE_DEFAULT).asUInt(),
+            STREAM_SAMPLERATE_MIN, STREAM_SAMPLERATE_MAX);
+    playbackBufferSize = root.get("playback-buffer-size", 0).asUInt();
+    if (playbackBufferSize != 0)
+        playbackBufferSize = std::clamp<size_t>(playbackBufferSize,
+                GetMinPlaybackBufferSize(sampleRate), STREAM_BUF_SIZE_MAX);
+
+    // Export file format and per format quality settings
+    exportFormat = str2exportFmt(root.get("export-format", "wav-float").asString());
+    flacCompressionLevel = std::clamp(root.get("export-flac-compression-level", 5).asInt(), 0, 8);
+    vorbisQuality = std::clamp(root.get("export-vorbis-quality", 0.6).asDouble(), 0.0, 1.0);
+    opusQuality = std::clamp(root.get("export-opus-quality", 0.6).asDouble(), 0.0, 1.0);
+    exportDither = root.get("export-dither", true).asBool();
+    exportCache = root.get("export-cache", true).asBool();
+
     for (Json::Value playlist : root["playlists"]) {
         // parse games
         std::vector<std::string> games;
@@ -169,6 +186,14 @@ void ConfigManager::Save()
     root["max-loops-export"] = maxLoopsExport;
     root["pad-seconds-start"] = padSecondsStart;
     root["pad-seconds-end"] = padSecondsEnd;
+    root["output-samplerate"] = sampleRate;
+    root["playback-buffer-size"] = static_cast<Json::UInt>(playbackBufferSize);
+    root["export-format"] = exportFmt2str(exportFormat);
+    root["export-flac-compression-level"] = flacCompressionLevel;
+    root["export-vorbis-quality"] = vorbisQuality;
+    root["export-opus-quality"] = opusQuality;
+    root["export-dither"] = exportDither;
+    root["export-cache"] = exportCache;
 
     std::filesystem::create_directories(configPath.parent_path());
     std::ofstream jsonFile(configPath);
@@ -240,3 +265,89 @@ void ConfigManager::SetPadSecondsEnd(double value)
     padSecondsEnd = value;
 }
 
+uint32_t ConfigManager::GetSampleRate() const
+{
+    return sampleRateOverride != 0 ? sampleRateOverride : sampleRate;
+}
+
+void ConfigManager::SetSampleRate(uint32_t value)
+{
+    sampleRate = value;
+}
+
+size_t ConfigManager::GetPlaybackBufferSize() const
+{
+    // the sample rate may have been overridden after the size was checked
+    const size_t minSize = GetMinPlaybackBufferSize(GetSampleRate());
+    size_t size = playbackBufferSizeOverride != 0 ? playbackBufferSizeOverride : playbackBufferSize;
+    if (size != 0)
+        return std::max(size, minSize);
+
+    // about 40 ms, rounded up to a power of two (2048 samples at 48 kHz)
+    size = STREAM_BUF_SIZE_MIN;
+    while (size < GetSampleRate() / 24 || size < minSize)
+        size <<= 1;
+    return size;
+}
+
+void ConfigManager::SetPlaybackBufferSize(size_t value)
+{
+    playbackBufferSize = value;
+}
+
+size_t ConfigManager::GetMinPlaybackBufferSize(uint32_t sampleRate)
+{
+    // microframes are rounded up to whole samples
+    const size_t microframe = (sampleRate + AGB_FPS * INTERFRAMES - 1) / (AGB_FPS * INTERFRAMES);
+    return std::max<size_t>(STREAM_BUF_SIZE_MIN, 2 * microframe);
+}
+
+ExportFormat ConfigManager::GetExportFormat() const
+{
+    return exportFormat;
+}
+
+void ConfigManager::SetExportFormat(ExportFormat value)
+{
+    exportFormat = value;
+}
+
+int ConfigManager::GetFlacCompressionLevel() const
+{
+    return flacCompressionLevel;
+}
+
+double ConfigManager::GetVorbisQuality() const
+{
+    return vorbisQuality;
+}
+
+double ConfigManager::GetOpusQuality() const
+{
+    return opusQuality;
+}
+
+bool ConfigManager::GetExportDither() const
+{
+    return exportDither;
+}
+
+bool ConfigManager::GetExportCache() const
+{
+    return exportCache;
+}
+
+void ConfigManager::SetExportCache(bool value)
+{
+    exportCache = value;
+}
+
+void ConfigManager::OverrideSampleRate(uint32_t value)
+{
+    sampleRateOverride = value;
+}
+
+void ConfigManager::OverridePlaybackBufferSize(size_t value)
+{
+    playbackBufferSizeOverride = value;
+}
@@ -27,6 +27,23 @@ public:
     void SetPadSecondsStart(double value);
     double GetPadSecondsEnd() const;
     void SetPadSecondsEnd(double value);
+    uint32_t GetSampleRate() const;
+    void SetSampleRate(uint32_t value);
+    size_t GetPlaybackBufferSize() const;
+    void SetPlaybackBufferSize(size_t value);
+    // the player puts one microframe at a time, the buffer has to fit two
+    static size_t GetMinPlaybackBufferSize(uint32_t sampleRate);
+    ExportFormat GetExportFormat() const;
+    void SetExportFormat(ExportFormat value);
+    int GetFlacCompressionLevel() const;
+    double GetVorbisQuality() const;
+    double GetOpusQuality() const;
+    bool GetExportDither() const;
+    bool GetExportCache() const;
+    void SetExportCache(bool value);
+    // command line overrides, these are not saved to the config file
+    void OverrideSampleRate(uint32_t value);
+    void OverridePlaybackBufferSize(size_t value);
 private:
     ConfigManager() = default;
     ConfigManager(const ConfigManager&) = delete;
@@ -40,4 +57,14 @@ private:
     GameConfig *curCfg = nullptr;
     double padSecondsStart;
     double padSecondsEnd;
+    uint32_t sampleRate;
+    size_t playbackBufferSize;
+    ExportFormat exportFormat;
+    int flacCompressionLevel;
+    double vorbisQuality;
+    double opusQuality;
+    bool exportDither;
+    bool exportCache;
+    uint32_t sampleRateOverride = 0;
+    size_t playbackBufferSizeOverride = 0;
 };
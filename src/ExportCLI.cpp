@@ -0,0 +1,367 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <cmath>
+#include <map>
+#include <cstring>
+
+// sorry, for some reason multiple versions of jsoncpp use different paths :/
+#if __has_include(<json/json.h>)
+#include <json/json.h>
+#include <json/writer.h>
+#else
+#include <jsoncpp/json/json.h>
+#include <jsoncpp/json/writer.h>
+#endif
+
+#include "ExportCLI.h"
+#include "SoundExporter.h"
+#include "SoundData.h"
+#include "Rom.h"
+#include "ScanCache.h"
+#include "ConfigManager.h"
+#include "Constants.h"
+#include "Debug.h"
+#include "Xcept.h"
+
+/*
+ * public ExportCLI
+ */
+
+bool ExportCLI::IsRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp("--export", argv[i]))
+            return true;
+    }
+    return false;
+}
+
+void ExportCLI::Usage()
+{
+    std::cout << "Usage: ./agbplay --export <ROM.gba> [table number] [options]\n"
+        "  --songs <list>: Songs to export, e.g. \"1,5-20\" (default: all songs)\n"
+        "  --out <dir>: Output directory (default: wav-output-dir from the config)\n"
+        "  --threads <N>: Number of render threads (default: one per CPU)\n"
+        "  --benchmark: Render without writing any files\n"
+        "  --digest: Like --benchmark, but print a hash and the level of each song\n"
+        "  --check <file.json>: Like --digest, and compare with the output of an earlier --digest run\n"
+        "  --separate: Write each track to a separate file\n"
+        "  --samplerate <Hz>: Output sample rate\n"
+        "  --format <format>: wav-float, wav-24, wav-16, flac-24, flac-16, vorbis or opus\n"
+        "  --stream <file>: Write all songs as raw PCM to a file or named pipe (\"-\" for stdout)\n"
+        "  --stream-format <format>: f32 (default) or s16\n"
+        "  --realtime: Write the stream at playback speed\n"
+        "  --playlist-file <name>: Write all songs to one file in the output directory\n"
+        "  --crossfade <seconds>: Overlap of consecutive songs with --stream or --playlist-file\n"
+        "  --no-cache: Render all songs, even if they are in the render cache\n" << std::flush;
+}
+
+ExportCLI::ExportCLI(int argc, char *argv[])
+{
+    bool songTableGiven = false;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp("--export", argv[i]) && hasValue) {
+            romPath = argv[++i];
+        } else if (!strcmp("--songs", argv[i]) && hasValue) {
+            songs = ParseSongList(argv[++i]);
+        } else if (!strcmp("--out", argv[i]) && hasValue) {
+            outputDir = argv[++i];
+        } else if (!strcmp("--threads", argv[i]) && hasValue) {
+            numThreads = ParseNumber(argv[i], argv[i + 1]);
+            i++;
+        } else if (!strcmp("--samplerate", argv[i]) && hasValue) {
+            sampleRate = static_cast<uint32_t>(ParseNumber(argv[i], argv[i + 1]));
+            if (sampleRate < STREAM_SAMPLERATE_MIN || sampleRate > STREAM_SAMPLERATE_MAX)
+                throw Xcept("--samplerate: %u Hz is out of range", sampleRate);
+            i++;
+        } else if (!strcmp("--format", argv[i]) && hasValue) {
+            format = argv[++i];
+            if (exportFmt2str(str2exportFmt(format)) != format)
+                throw Xcept("--format: unknown format: %s", format.c_str());
+        } else if (!strcmp("--stream", argv[i]) && hasValue) {
+            streamPath = argv[++i];
+        } else if (!strcmp("--stream-format", argv[i]) && hasValue) {
+            i++;
+            if (!strcmp("f32", argv[i]))
+                streamFormat = RawFormat::F32;
+            else if (!strcmp("s16", argv[i]))
+                streamFormat = RawFormat::S16;
+            else
+                throw Xcept("--stream-format: unknown format: %s", argv[i]);
+        } else if (!strcmp("--playlist-file", argv[i]) && hasValue) {
+            playlistFile = argv[++i];
+        } else if (!strcmp("--crossfade", argv[i]) && hasValue) {
+            char *end;
+            crossfadeSeconds = strtod(argv[i + 1], &end);
+            if (*argv[i + 1] == '\0' || *end != '\0' || !(crossfadeSeconds >= 0.0))
+                throw Xcept("--crossfade: invalid number of seconds: %s", argv[i + 1]);
+            i++;
+        } else if (!strcmp("--no-cache", argv[i])) {
+            noCache = true;
+        } else if (!strcmp("--realtime", argv[i])) {
+            realtime = true;
+        } else if (!strcmp("--benchmark", argv[i])) {
+            benchmarkOnly = true;
+        } else if (!strcmp("--digest", argv[i])) {
+            digest = true;
+        } else if (!strcmp("--check", argv[i]) && hasValue) {
+            checkFile = argv[++i];
+            digest = true;
+        } else if (!strcmp("--separate", argv[i])) {
+            separate = true;
+        } else if (argv[i][0] != '-' && !songTableGiven) {
+            songTableIndex = ParseNumber("table number", argv[i]);
+            songTableGiven = true;
+        } else {
+            throw Xcept("Invalid argument: %s", argv[i]);
+        }
+    }
+    if (romPath.empty())
+        throw Xcept("--export: no ROM specified");
+    if (!streamPath.empty() && separate)
+        throw Xcept("--stream: separate tracks can't be streamed");
+    if (!playlistFile.empty() && separate)
+        throw Xcept("--playlist-file: separate tracks can't be written to one file");
+    if (!playlistFile.empty() && !streamPath.empty())
+        throw Xcept("--playlist-file and --stream can't be used together");
+    if (digest && (separate || !streamPath.empty() || !playlistFile.empty()))
+        throw Xcept("--digest: only the mixed output of each song can be checked");
+    // nothing is written when checking the output
+    if (digest)
+        benchmarkOnly = true;
+}
+
+int ExportCLI::Run()
+{
+    // the GUI console isn't available, so send all messages to stderr
+    Debug::set_callback([](const std::string& msg, void *) {
+        std::cerr << msg << std::endl;
+    }, nullptr);
+
+    Rom::CreateInstance(romPath.c_str());
+    ConfigManager::Instance().Load();
+    if (sampleRate != 0)
+        ConfigManager::Instance().OverrideSampleRate(sampleRate);
+    if (!format.empty())
+        ConfigManager::Instance().SetExportFormat(str2exportFmt(format));
+    if (noCache)
+        ConfigManager::Instance().SetExportCache(false);
+
+    std::vector<SongTable> songTables = ScanCache::Instance().ScanForTables();
+    if (songTableIndex >= songTables.size())
+        throw Xcept("Songtable index out of range");
+    if (songTableIndex > 0) {
+        std::ostringstream ss;
+        ss << Rom::Instance().GetROMCode() << ":" << songTableIndex;
+        ConfigManager::Instance().SetGameCode(ss.str());
+    } else {
+        ConfigManager::Instance().SetGameCode(Rom::Instance().GetROMCode());
+    }
+    SongTable& songTable = songTables[songTableIndex];
+
+    // songs are identified by their index, the reference decides which songs are rendered
+    std::map<uint16_t, Json::Value> reference;
+    if (!checkFile.empty()) {
+        reference = loadReference(checkFile);
+        if (songs.empty()) {
+            for (const auto& [uid, song] : reference)
+                songs.push_back(uid);
+        }
+    }
+    if (songs.empty()) {
+        for (size_t i = 0; i < songTable.GetNumSongs(); i++)
+            songs.push_back(static_cast<uint16_t>(i));
+    }
+
+    // use the names from the playlist if the song is tagged
+    const auto& gameEntries = ConfigManager::Instance().GetCfg().GetGameEntries();
+    std::vector<SongEntry> entries;
+    for (uint16_t uid : songs) {
+        if (uid >= songTable.GetNumSongs())
+            throw Xcept("Song %u doesn't exist, the songtable only has %zu songs", uid, songTable.GetNumSongs());
+        std::ostringstream name;
+        name << std::setw(4) << std::setfill('0') << uid;
+        for (const SongEntry& gameEntry : gameEntries) {
+            if (gameEntry.GetUID() == uid) {
+                name.str(gameEntry.GetName());
+                break;
+            }
+        }
+        entries.emplace_back(name.str(), uid);
+    }
+
+    if (outputDir.empty())
+        outputDir = ConfigManager::Instance().GetWavOutputDir();
+
+    SoundExporter se(songTable, outputDir, benchmarkOnly, separate, numThreads);
+    if (!streamPath.empty())
+        se.SetStream(streamPath, streamFormat, realtime);
+    if (!playlistFile.empty())
+        se.SetPlaylistFile(playlistFile);
+    se.SetCrossfade(crossfadeSeconds);
+    se.SetDigest(digest);
+    ExportResult result = se.Export(entries);
+
+    size_t totalSamples = 0;
+    size_t mismatches = 0;
+    size_t failures = 0;
+    Json::Value songsJson(Json::arrayValue);
+    for (const SongExportResult& song : result.songs) {
+        Json::Value songJson;
+        songJson["index"] = song.uid;
+        songJson["name"] = song.name;
+        if (!benchmarkOnly)
+            songJson["file"] = song.fileName.string();
+        songJson["samples"] = static_cast<Json::UInt64>(song.samplesRendered);
+        songJson["estimated-length"] = song.estimatedSeconds;
+        songJson["seconds"] = song.seconds;
+        if (!benchmarkOnly) {
+            songJson["cached"] = song.cached;
+            songJson["failed"] = song.failed;
+        }
+        if (song.failed)
+            failures++;
+        if (digest) {
+            std::ostringstream hash;
+            hash << std::hex << std::setw(16) << std::setfill('0') << song.digest.hash;
+            songJson["digest"] = hash.str();
+            songJson["rms-db"] = dbJson(song.digest.GetRmsDb());
+            songJson["peak-db"] = dbJson(song.digest.GetPeakDb());
+        }
+        if (!checkFile.empty()) {
+            const bool matches = checkSong(songJson, reference);
+            songJson["matches"] = matches;
+            if (!matches)
+                mismatches++;
+        }
+        songsJson.append(songJson);
+        totalSamples += song.samplesRendered;
+    }
+
+    Json::Value root;
+    root["rom"] = romPath;
+    root["table"] = static_cast<Json::UInt64>(songTableIndex);
+    root["samplerate"] = result.sampleRate;
+    root["threads"] = static_cast<Json::UInt64>(result.numThreads);
+    root["benchmark"] = benchmarkOnly;
+    root["samples"] = static_cast<Json::UInt64>(totalSamples);
+    root["seconds"] = result.seconds;
+    // how many seconds of audio were rendered per second
+    if (result.seconds > 0.0)
+        root["realtime-factor"] = double(totalSamples) / double(result.sampleRate) / result.seconds;
+    if (!checkFile.empty()) {
+        root["reference"] = checkFile;
+        root["mismatches"] = static_cast<Json::UInt64>(mismatches);
+    }
+    if (!benchmarkOnly)
+        root["failures"] = static_cast<Json::UInt64>(failures);
+    root["songs"] = songsJson;
+
+    Json::StreamWriterBuilder builder;
+    builder["commentStyle"] = "None";
+    builder["indentation"] = "";
+    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    // stdout may already be taken by the audio stream
+    std::ostream& out = streamPath == "-" ? std::cerr : std::cout;
+    writer->write(root, &out);
+    out << std::endl;
+
+    if (mismatches > 0)
+        Debug::print("%zu of %zu songs differ from %s", mismatches, result.songs.size(), checkFile.c_str());
+    else if (!checkFile.empty())
+        Debug::print("All %zu songs match %s", result.songs.size(), checkFile.c_str());
+    // songs that couldn't be written completely fail the export as well
+    return (mismatches > 0 || failures > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+std::vector<uint16_t> ExportCLI::ParseSongList(const std::string& list)
+{
+    std::vector<uint16_t> result;
+    std::istringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty())
+            continue;
+        size_t dash = item.find('-');
+        unsigned long first = ParseNumber("--songs", item.substr(0, dash).c_str());
+        unsigned long last = first;
+        if (dash != std::string::npos)
+            last = ParseNumber("--songs", item.substr(dash + 1).c_str());
+        if (last < first || last > 0xFFFF)
+            throw Xcept("--songs: invalid range: %s", item.c_str());
+        for (unsigned long uid = first; uid <= last; uid++)
+            result.push_back(static_cast<uint16_t>(uid));
+    }
+    if (result.empty())
+        throw Xcept("--songs: no songs specified");
+    return result;
+}
+
+unsigned long ExportCLI::ParseNumber(const char *option, const char *value)
+{
+    char *end;
+    unsigned long result = strtoul(value, &end, 0);
+    if (*value == '\0' || *end != '\0')
+        throw Xcept("%s: invalid number: %s", option, value);
+    return result;
+}
+
+/*
+ * private ExportCLI
+ */
+
+Json::Value ExportCLI::dbJson(double db)
+{
+    // silence has no finite level, which JSON can't represent
+    if (!std::isfinite(db))
+        return Json::Value();
+    return db;
+}
+
+std::map<uint16_t, Json::Value> ExportCLI::loadReference(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw Xcept("--check: opening %s failed", path.c_str());
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors))
+        throw Xcept("--check: parsing %s failed: %s", path.c_str(), errors.c_str());
+
+    std::map<uint16_t, Json::Value> reference;
+    for (const Json::Value& song : root["songs"]) {
+        if (!song.isMember("index") || !song.isMember("digest"))
+            throw Xcept("--check: %s wasn't written with --digest", path.c_str());
+        reference[static_cast<uint16_t>(song["index"].asUInt())] = song;
+    }
+    if (reference.empty())
+        throw Xcept("--check: %s doesn't contain any songs", path.c_str());
+    return reference;
+}
+
+bool ExportCLI::checkSong(const Json::Value& song, const std::map<uint16_t, Json::Value>& reference)
+{
+    const uint16_t uid = static_cast<uint16_t>(song["index"].asUInt());
+    auto it = reference.find(uid);
+    if (it == reference.end()) {
+        Debug::print("Song %u: not in the reference", uid);
+        return false;
+    }
+    const Json::Value& ref = it->second;
+    if (song["digest"].asString() == ref["digest"].asString() && song["samples"].asUInt64() == ref["samples"].asUInt64())
+        return true;
+
+    // the levels give an idea of how much the output changed
+    auto db = [](const Json::Value& v) {
+        return v.isNull() ? std::string("-inf") : std::to_string(v.asDouble());
+    };
+    Debug::print("Song %u: differs, %s instead of %s samples, RMS %s dB instead of %s dB, peak %s dB instead of %s dB",
+            uid, song["samples"].asString().c_str(), ref["samples"].asString().c_str(),
+            db(song["rms-db"]).c_str(), db(ref["rms-db"]).c_str(),
+            db(song["peak-db"]).c_str(), db(ref["peak-db"]).c_str());
+    return false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+
+// sorry, for some reason multiple versions of jsoncpp use different paths :/
+#if __has_include(<json/json.h>)
+#include <json/json.h>
+#else
+#include <jsoncpp/json/json.h>
+#endif
+
+#include "ExportSink.h"
+
+/*
+ * Non-interactive export/benchmark mode:
+ *
+ *   agbplay --export <ROM.gba> [table number] [--songs 1,5-20] [--out dir]
+ *           [--threads N] [--benchmark] [--separate] [--samplerate Hz]
+ *           [--format fmt] [--stream file|- [--stream-format f32|s16] [--realtime]]
+ *           [--playlist-file name] [--crossfade seconds] [--no-cache]
+ *           [--digest] [--check reference.json]
+ *
+ * Neither curses nor PortAudio are initialized, so this works without a
+ * terminal or sound device. Progress goes to stderr, the timing results are
+ * printed to stdout as JSON.
+ *
+ * --digest adds a hash of each song's rendered audio to the JSON, --check
+ * compares these with a saved JSON file, so changes to the engine can be
+ * checked for audible differences (the exit status is 1 if any song differs).
+ */
+class ExportCLI
+{
+public:
+    static bool IsRequested(int argc, char *argv[]);
+    static void Usage();
+
+    ExportCLI(int argc, char *argv[]);
+    ExportCLI(const ExportCLI&) = delete;
+    ExportCLI& operator=(const ExportCLI&) = delete;
+
+    int Run();
+
+    // also used by the benchmark
+    static std::vector<uint16_t> ParseSongList(const std::string& list);
+    static unsigned long ParseNumber(const char *option, const char *value);
+private:
+    static Json::Value dbJson(double db);
+    static std::map<uint16_t, Json::Value> loadReference(const std::string& path);
+    static bool checkSong(const Json::Value& song, const std::map<uint16_t, Json::Value>& reference);
+
+    std::string romPath;
+    size_t songTableIndex = 0;
+    std::vector<uint16_t> songs;    // empty: all songs of the table
+    std::filesystem::path outputDir;
+    size_t numThreads = 0;
+    uint32_t sampleRate = 0;
+    std::string format;     // empty: export-format from the config
+    std::string streamPath; // empty: write files
+    RawFormat streamFormat = RawFormat::F32;
+    bool realtime = false;
+    std::string playlistFile;   // empty: one file per song
+    double crossfadeSeconds = 0.0;
+    bool noCache = false;
+    bool benchmarkOnly = false;
+    bool digest = false;
+    std::string checkFile;  // empty: don't compare the digests
+    bool separate = false;
+};
@@ -0,0 +1,196 @@
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+#include <fstream>
+#include <memory>
+#include <filesystem>
+
+// sorry, for some reason multiple versions of jsoncpp use different paths :/
+#if __has_include(<json/json.h>)
+#include <json/json.h>
+#include <json/writer.h>
+#else
+#include <jsoncpp/json/json.h>
+#include <jsoncpp/json/writer.h>
+#endif
+
+#include "ExportSink.h"
+#include "Debug.h"
+#include "Xcept.h"
+#include "OS.h"
+#include "Util.h"
+
+/*
+ * public Quantizer
+ */
+
+Quantizer::Quantizer(unsigned bits, bool dither, uint32_t seed)
+    // xorshift never leaves 0
+    : scale(float((1u << (bits - 1)) - 1)), shift(32 - bits), dither(dither), rng(seed != 0 ? seed : 0x12345678u)
+{
+}
+
+uint32_t Quantizer::MakeSeed(const std::string& name)
+{
+    const uint64_t hash = Fnv1a64(name.data(), name.size());
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+void Quantizer::Process(const std::vector<sample>& data, std::vector<int32_t>& out)
+{
+    const float lowest = -scale - 1.0f;
+    auto quantize = [&](float x) {
+        float v = x * scale;
+        // triangular PDF dither of +-1 LSB, sum of two uniform random values
+        if (dither)
+            v += noise() - noise();
+        v = std::clamp(std::round(v), lowest, scale);
+        return static_cast<int32_t>(static_cast<uint32_t>(static_cast<int32_t>(v)) << shift);
+    };
+
+    out.resize(data.size() * 2);
+    for (size_t i = 0; i < data.size(); i++) {
+        out[i * 2] = quantize(data[i].left);
+        out[i * 2 + 1] = quantize(data[i].right);
+    }
+}
+
+/*
+ * private Quantizer
+ */
+
+float Quantizer::noise()
+{
+    // xorshift32, uniform in [0, 1)
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return float(rng >> 8) * (1.0f / 16777216.0f);
+}
+
+/*
+ * public SndfileSink
+ */
+
+SndfileSink::SndfileSink(SNDFILE *file, unsigned intBits, bool dither, uint32_t ditherSeed)
+    : file(file), intBits(intBits), quantizer(intBits != 0 ? intBits : 16, dither, ditherSeed)
+{
+}
+
+SndfileSink::~SndfileSink()
+{
+    int err = sf_close(file);
+    if (err != 0)
+        Debug::print("Error: %s", sf_error_number(err));
+}
+
+bool SndfileSink::Write(const std::vector<sample>& data)
+{
+    /* libsndfile expects integers scaled to the full 32 bit range and drops
+     * the lower bits, so the quantization is done here at the target depth. */
+    if (intBits != 0)
+        quantizer.Process(data, intData);
+
+    const sf_count_t frames = static_cast<sf_count_t>(data.size());
+    sf_count_t processed = 0;
+    while (processed < frames) {
+        const size_t offset = static_cast<size_t>(processed);
+        sf_count_t written;
+        if (intBits != 0)
+            written = sf_writef_int(file, &intData[offset * 2], frames - processed);
+        else
+            written = sf_writef_float(file, &data[offset].left, frames - processed);
+        if (written <= 0) {
+            Debug::print("Error: %s", sf_strerror(file));
+            return false;
+        }
+        processed += written;
+    }
+    return true;
+}
+
+/*
+ * public RawSink
+ */
+
+RawSink::RawSink(const std::string& path, RawFormat format, uint32_t sampleRate, bool dither, bool realtime)
+    : isStdout(path == "-"), format(format), sampleRate(sampleRate), realtime(realtime),
+      quantizer(16, dither, Quantizer::MakeSeed(std::filesystem::path(path).filename().string()))
+{
+    if (isStdout) {
+        OS::SetBinaryStdout();
+        file = stdout;
+        Debug::print("Streaming to stdout: %s", describe().c_str());
+    } else {
+        std::ofstream sidecar(path + ".json");
+        if (!sidecar.is_open())
+            throw Xcept("Error while writing %s.json: %s", path.c_str(), strerror(errno));
+        sidecar << describe() << std::endl;
+        sidecar.close();
+
+        // opening a named pipe blocks until the other side is opened as well
+        Debug::print("Streaming to %s", path.c_str());
+        file = fopen(path.c_str(), "wb");
+        if (file == NULL)
+            throw Xcept("Error while opening %s: %s", path.c_str(), strerror(errno));
+    }
+    startTime = std::chrono::steady_clock::now();
+}
+
+RawSink::~RawSink()
+{
+    if (isStdout)
+        fflush(file);
+    else
+        fclose(file);
+}
+
+bool RawSink::Write(const std::vector<sample>& data)
+{
+    size_t written;
+    if (format == RawFormat::S16) {
+        quantizer.Process(data, intData);
+        s16Data.resize(intData.size());
+        for (size_t i = 0; i < intData.size(); i++)
+            s16Data[i] = static_cast<int16_t>(intData[i] >> 16);
+        written = fwrite(s16Data.data(), sizeof(int16_t) * 2, data.size(), file);
+    } else {
+        written = fwrite(data.data(), sizeof(sample), data.size(), file);
+    }
+    if (written != data.size()) {
+        Debug::print("Error while streaming audio: %s", strerror(errno));
+        return false;
+    }
+
+    framesWritten += data.size();
+    if (realtime) {
+        fflush(file);
+        std::this_thread::sleep_until(startTime + std::chrono::duration<double>(double(framesWritten) / sampleRate));
+    }
+    return true;
+}
+
+/*
+ * private RawSink
+ */
+
+std::string RawSink::describe() const
+{
+    const uint16_t endianTest = 1;
+    const bool littleEndian = *reinterpret_cast<const uint8_t *>(&endianTest) == 1;
+    // names as used by ffmpeg's -f option
+    std::string sampleFormat = format == RawFormat::S16 ? "s16" : "f32";
+    sampleFormat += littleEndian ? "le" : "be";
+
+    Json::Value root;
+    root["format"] = sampleFormat;
+    root["samplerate"] = sampleRate;
+    root["channels"] = 2;
+
+    Json::StreamWriterBuilder builder;
+    builder["commentStyle"] = "None";
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <sndfile.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+#include "Types.h"
+
+/*
+ * Destination of exported audio. Sinks are written to by the export writer
+ * thread and closed by destroying them.
+ */
+class ExportSink
+{
+public:
+    virtual ~ExportSink() = default;
+    // returns false if writing failed (the error has already been printed)
+    virtual bool Write(const std::vector<sample>& data) = 0;
+};
+
+/*
+ * Converts float samples to integers with the given number of bits, optionally
+ * with TPDF dither. The results are scaled to the full 32 bit range, so they
+ * can be passed to libsndfile or shifted down to the target size. The dither
+ * noise only depends on the seed, use a different one for each file (e.g.
+ * MakeSeed() of its name), so that the noise of separate tracks doesn't add up
+ * in phase when they are mixed.
+ */
+class Quantizer
+{
+public:
+    Quantizer(unsigned bits, bool dither, uint32_t seed);
+
+    static uint32_t MakeSeed(const std::string& name);
+
+    void Process(const std::vector<sample>& data, std::vector<int32_t>& out);
+private:
+    float noise();
+
+    float scale;
+    unsigned shift;
+    bool dither;
+    uint32_t rng;
+};
+
+/* audio file written by libsndfile, intBits == 0 writes float samples */
+class SndfileSink : public ExportSink
+{
+public:
+    SndfileSink(SNDFILE *file, unsigned intBits, bool dither, uint32_t ditherSeed);
+    SndfileSink(const SndfileSink&) = delete;
+    SndfileSink& operator=(const SndfileSink&) = delete;
+    ~SndfileSink() override;
+
+    bool Write(const std::vector<sample>& data) override;
+private:
+    SNDFILE *file;
+    unsigned intBits;
+    Quantizer quantizer;
+    std::vector<int32_t> intData;
+};
+
+enum class RawFormat { F32, S16 };
+
+/*
+ * Headerless interleaved stereo PCM in native byte order, written to stdout
+ * (path "-") or any other file like a named pipe. The format is described in
+ * a JSON sidecar "<path>.json", or printed for stdout. If realtime is set,
+ * writing is slowed down to the playback speed (e.g. for streaming servers).
+ */
+class RawSink : public ExportSink
+{
+public:
+    RawSink(const std::string& path, RawFormat format, uint32_t sampleRate, bool dither, bool realtime);
+    RawSink(const RawSink&) = delete;
+    RawSink& operator=(const RawSink&) = delete;
+    ~RawSink() override;
+
+    bool Write(const std::vector<sample>& data) override;
+private:
+    std::string describe() const;
+
+    FILE *file;
+    bool isStdout;
+    RawFormat format;
+    uint32_t sampleRate;
+    bool realtime;
+    Quantizer quantizer;
+    std::vector<int32_t> intData;
+    std::vector<int16_t> s16Data;
+    size_t framesWritten = 0;
+    std::chrono::steady_clock::time_point startTime;
+};
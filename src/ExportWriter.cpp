@@ -0,0 +1,91 @@
+#include "ExportWriter.h"
+#include "Debug.h"
+
+/*
+ * public ExportWriter
+ */
+
+ExportWriter::ExportWriter(size_t maxQueuedSamples)
+    : maxQueuedSamples(maxQueuedSamples), writerThread(&ExportWriter::worker, this)
+{
+}
+
+ExportWriter::~ExportWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        quit = true;
+    }
+    jobAdded.notify_one();
+    writerThread.join();
+}
+
+std::vector<sample> ExportWriter::GetBuffer()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    if (freeBuffers.empty())
+        return std::vector<sample>();
+    std::vector<sample> buffer = std::move(freeBuffers.back());
+    freeBuffers.pop_back();
+    return buffer;
+}
+
+void ExportWriter::Write(ExportSink *sink, std::vector<sample>&& data)
+{
+    push(Job{sink, std::move(data), nullptr, nullptr});
+}
+
+void ExportWriter::Close(std::unique_ptr<ExportSink>&& sink, bool *failed)
+{
+    push(Job{nullptr, std::vector<sample>(), std::move(sink), failed});
+}
+
+/*
+ * private ExportWriter
+ */
+
+void ExportWriter::push(Job&& job)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    // always accept a job if nothing is queued, so that oversized blocks can't dead lock
+    jobDone.wait(lock, [&]() {
+        return queuedSamples == 0 || queuedSamples + job.data.size() <= maxQueuedSamples;
+    });
+    queuedSamples += job.data.size();
+    jobs.emplace_back(std::move(job));
+    lock.unlock();
+    jobAdded.notify_one();
+}
+
+void ExportWriter::worker()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        jobAdded.wait(lock, [this]() { return quit || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        if (job.close) {
+            // the address may be reused by a later sink
+            const bool sinkFailed = failedSinks.erase(job.close.get()) > 0;
+            if (sinkFailed && job.failed)
+                *job.failed = true;
+            job.close.reset();
+        } else if (failedSinks.count(job.sink) == 0) {
+            if (!job.sink->Write(job.data))
+                failedSinks.insert(job.sink);
+        }
+
+        lock.lock();
+        queuedSamples -= job.data.size();
+        if (job.data.capacity() > 0) {
+            job.data.clear();
+            freeBuffers.emplace_back(std::move(job.data));
+        }
+        jobDone.notify_all();
+    }
+}
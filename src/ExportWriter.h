@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <cstddef>
+
+#include "Types.h"
+#include "ExportSink.h"
+
+/*
+ * Writes audio blocks to their sinks on a separate thread, so encoding and
+ * disk I/O don't stall the render threads. At most maxQueuedSamples are
+ * queued at a time, render threads block in Write() beyond that. Blocks and
+ * closes of the same sink are processed in the order they were queued.
+ * After the first failed write to a sink, its remaining blocks are dropped.
+ * The destructor waits until everything has been written.
+ */
+class ExportWriter
+{
+public:
+    ExportWriter(size_t maxQueuedSamples);
+    ExportWriter(const ExportWriter&) = delete;
+    ExportWriter& operator=(const ExportWriter&) = delete;
+    ~ExportWriter();
+
+    // returns a recycled buffer to avoid reallocating for each block
+    std::vector<sample> GetBuffer();
+    void Write(ExportSink *sink, std::vector<sample>&& data);
+    /* the sink is destroyed after all previously queued blocks have been written,
+     * if any of them failed, *failed is set to true on the writer thread */
+    void Close(std::unique_ptr<ExportSink>&& sink, bool *failed = nullptr);
+private:
+    struct Job {
+        ExportSink *sink;
+        std::vector<sample> data;
+        std::unique_ptr<ExportSink> close;
+        bool *failed;
+    };
+
+    void push(Job&& job);
+    void worker();
+
+    const size_t maxQueuedSamples;
+    size_t queuedSamples = 0;
+    bool quit = false;
+    std::deque<Job> jobs;
+    std::vector<std::vector<sample>> freeBuffers;
+    std::unordered_set<const ExportSink *> failedSinks;     // only used by the writer thread
+    std::mutex mtx;
+    std::condition_variable jobAdded;
+    std::condition_variable jobDone;
+    std::thread writerThread;
+};
@@ -2,16 +2,17 @@
 #include <cassert>
 
 #include "LoudnessCalculator.h"
-#include "Constants.h"
 #include "Util.h"
+#include "Profiler.h"
 
-LoudnessCalculator::LoudnessCalculator(const float lowpassFreq)
-    : lpAlpha(calcAlpha(lowpassFreq))
+LoudnessCalculator::LoudnessCalculator(const float lowpassFreq, const uint32_t sampleRate)
+    : lpAlpha(calcAlpha(lowpassFreq, sampleRate))
 {
 }
 
 void LoudnessCalculator::CalcLoudness(const sample *audio, size_t numSamples)
 {
+    PROFILE_SCOPE(ProfileStage::LOUDNESS);
     do {
         float l = audio->left;
         float r = audio->right;
@@ -44,9 +45,9 @@ void LoudnessCalculator::Reset()
     volRight = 0.f;
 }
 
-float LoudnessCalculator::calcAlpha(float lowpassFreq)
+float LoudnessCalculator::calcAlpha(float lowpassFreq, uint32_t sampleRate)
 {
     float rc = 1.0f / (lowpassFreq * 2.0f * float(M_PI));
-    float dt = 1.0f / float(STREAM_SAMPLERATE);
+    float dt = 1.0f / float(sampleRate);
     return dt / (rc + dt);
 }
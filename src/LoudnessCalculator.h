@@ -1,13 +1,14 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 #include "Types.h"
 
 class LoudnessCalculator
 {
 public:
-    LoudnessCalculator(const float lowpassFreq);
+    LoudnessCalculator(const float lowpassFreq, const uint32_t sampleRate);
     LoudnessCalculator(const LoudnessCalculator&) = delete;
     LoudnessCalculator(LoudnessCalculator&&) = default;
     LoudnessCalculator& operator=(const LoudnessCalculator&) = delete;
@@ -16,7 +17,7 @@ public:
     void GetLoudness(float& lVol, float& rVol);
     void Reset();
 private:
-    static float calcAlpha(float lowpassFreq);
+    static float calcAlpha(float lowpassFreq, uint32_t sampleRate);
 
     float lpAlpha;
     float avgVolLeftSq = 0.0f;
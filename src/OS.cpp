@@ -4,12 +4,19 @@
 
 #include <filesystem>
 #include <iostream>
+#include <thread>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 
 #if defined(_WIN32)
 // if we compile for Windows native
 
 #include <windows.h>
 #include <shlobj.h>
+#include <io.h>
+#include <fcntl.h>
+#include <cstdio>
 
 void OS::LowerThreadPriority()
 {
@@ -17,6 +24,61 @@ void OS::LowerThreadPriority()
     SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
 }
 
+void OS::SetBinaryStdout()
+{
+    _setmode(_fileno(stdout), _O_BINARY);
+}
+
+void OS::FutexWait(std::atomic<uint32_t>& word, uint32_t expected)
+{
+    /* WaitOnAddress would require linking against synchronization.lib,
+     * polling with a short sleep is good enough for the player thread */
+    if (word.load() == expected)
+        Sleep(1);
+}
+
+void OS::FutexWake(std::atomic<uint32_t>&)
+{
+}
+
+void OS::FutexWakeAll(std::atomic<uint32_t>&)
+{
+}
+
+const void *OS::MapFile(const std::filesystem::path& filePath, size_t& size)
+{
+    HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    // the view keeps the mapping and the file open
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return nullptr;
+    const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL)
+        return nullptr;
+    size = static_cast<size_t>(fileSize.QuadPart);
+    return data;
+}
+
+void OS::UnmapFile(const void *data, size_t)
+{
+    UnmapViewOfFile(data);
+}
+
+bool OS::CloneFile(const std::filesystem::path&, const std::filesystem::path&)
+{
+    return false;
+}
+
 const std::filesystem::path OS::GetMusicDirectory()
 {
     PWSTR folderPath = NULL;
@@ -56,12 +118,36 @@ const std::filesystem::path OS::GetGlobalConfigDirectory()
     return retval;
 }
 
+const std::filesystem::path OS::GetCacheDirectory()
+{
+    PWSTR folderPath = NULL;
+    HRESULT result = SHGetKnownFolderPath(FOLDERID_LocalAppData, KF_FLAG_DEFAULT, NULL, &folderPath);
+
+    if (result != S_OK)
+        throw Xcept("SHGetKnownFolderPath: Failed to retrieve LocalAppData folder");
+
+    std::filesystem::path retval(folderPath);
+    CoTaskMemFree(folderPath);
+    return retval;
+}
+
 #elif __has_include(<unistd.h>)
 // if we compile for a UNIX'oid
 
 #include <unistd.h>
 #include <pwd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if __has_include(<linux/futex.h>)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#if __has_include(<linux/fs.h>)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 
 void OS::LowerThreadPriority()
 {
@@ -69,6 +155,98 @@ void OS::LowerThreadPriority()
     nice(15);
 }
 
+void OS::SetBinaryStdout()
+{
+    // there is no text mode on UNIX
+}
+
+#if __has_include(<linux/futex.h>)
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+
+void OS::FutexWait(std::atomic<uint32_t>& word, uint32_t expected)
+{
+    // EINTR and EAGAIN are fine, the caller checks its condition again
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void OS::FutexWake(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void OS::FutexWakeAll(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+#else
+void OS::FutexWait(std::atomic<uint32_t>& word, uint32_t expected)
+{
+    // no futex (e.g. macOS), poll with a short sleep instead
+    if (word.load() == expected)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void OS::FutexWake(std::atomic<uint32_t>&)
+{
+}
+
+void OS::FutexWakeAll(std::atomic<uint32_t>&)
+{
+}
+#endif
+
+const void *OS::MapFile(const std::filesystem::path& filePath, size_t& size)
+{
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    size_t fileSize = static_cast<size_t>(st.st_size);
+    // private, so changes to the file by other programs can't be seen
+    void *data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+    /* ROMs are small compared to the memory of any machine and the song table
+     * scan reads all of them, so fault everything in early. The later accesses
+     * are all over the place. */
+    madvise(data, fileSize, MADV_WILLNEED);
+    madvise(data, fileSize, MADV_RANDOM);
+    size = fileSize;
+    return data;
+}
+
+void OS::UnmapFile(const void *data, size_t size)
+{
+    munmap(const_cast<void *>(data), size);
+}
+
+bool OS::CloneFile([[maybe_unused]] const std::filesystem::path& from, [[maybe_unused]] const std::filesystem::path& to)
+{
+#ifdef FICLONE
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in == -1)
+        return false;
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (out == -1) {
+        close(in);
+        return false;
+    }
+    const bool cloned = ioctl(out, FICLONE, in) == 0;
+    close(in);
+    close(out);
+    if (!cloned)
+        unlink(to.c_str());
+    return cloned;
+#else
+    return false;
+#endif
+}
+
 const std::filesystem::path OS::GetMusicDirectory()
 {
     passwd *pw = getpwuid(getuid());
@@ -94,6 +272,20 @@ const std::filesystem::path OS::GetGlobalConfigDirectory()
     return std::filesystem::path("/etc");
 }
 
+const std::filesystem::path OS::GetCacheDirectory()
+{
+    const char *xdgCache = getenv("XDG_CACHE_HOME");
+    if (xdgCache && xdgCache[0] != '\0')
+        return std::filesystem::path(xdgCache);
+
+    passwd *pw = getpwuid(getuid());
+    if (!pw)
+        throw Xcept("getpwuid failed: %s", strerror(errno));
+
+    std::filesystem::path retval(pw->pw_dir);
+    return retval / ".cache";
+}
+
 #else
 // Unsupported OS
 #error "Apparently your OS is neither Windows nor appears to be a UNIX variant (no unistd.h). You will have to add support for your OS in src/OS.cpp :/"
@@ -1,12 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <filesystem>
 
 namespace OS {
     void LowerThreadPriority();
     void CheckTerminal();
+    // switch stdout to binary mode (no newline translation) for raw audio output
+    void SetBinaryStdout();
+    // block while word == expected (may return spuriously), wake one waiter
+    void FutexWait(std::atomic<uint32_t>& word, uint32_t expected);
+    void FutexWake(std::atomic<uint32_t>& word);
+    void FutexWakeAll(std::atomic<uint32_t>& word);
+    /* map a whole file read-only into memory, returns nullptr if that isn't
+     * possible (e.g. empty files or pipes), the caller may read it instead */
+    const void *MapFile(const std::filesystem::path& filePath, size_t& size);
+    void UnmapFile(const void *data, size_t size);
+    /* create "to" as a copy-on-write clone of "from" (reflink), returns false
+     * if the file system doesn't support that, the caller has to copy instead */
+    bool CloneFile(const std::filesystem::path& from, const std::filesystem::path& to);
     const std::filesystem::path GetMusicDirectory();
     const std::filesystem::path GetLocalConfigDirectory();
     const std::filesystem::path GetGlobalConfigDirectory();
+    const std::filesystem::path GetCacheDirectory();
 };
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "PlaybackStats.h"
+
+/*
+ * public PlaybackStats
+ */
+
+PlaybackStats::PlaybackStats(double sampleRate)
+    : sampleRate(sampleRate)
+{
+}
+
+void PlaybackStats::Start()
+{
+    microframes.store(0, std::memory_order_relaxed);
+    renderSumNs.store(0, std::memory_order_relaxed);
+    renderMinNs.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    for (counter& c : renderHistogram)
+        c.store(0, std::memory_order_relaxed);
+
+    // the audio callback may be running, it resets its counters once it sees this
+    generation.fetch_add(1, std::memory_order_release);
+    active.store(true, std::memory_order_release);
+}
+
+void PlaybackStats::Stop()
+{
+    active.store(false, std::memory_order_release);
+}
+
+void PlaybackStats::RecordRender(std::chrono::steady_clock::duration renderTime)
+{
+    const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(renderTime).count());
+    inc(microframes);
+    inc(renderSumNs, ns);
+    if (ns < renderMinNs.load(std::memory_order_relaxed))
+        renderMinNs.store(ns, std::memory_order_relaxed);
+    const size_t bucket = std::min<uint64_t>(ns / (RENDER_BUCKET_US * 1000), RENDER_BUCKETS - 1);
+    inc(renderHistogram[bucket]);
+}
+
+void PlaybackStats::RecordCallback(size_t fillLevel, size_t bufferSize, size_t frames,
+        bool underrun, bool outputUnderflow, bool outputOverflow)
+{
+    const uint32_t gen = generation.load(std::memory_order_acquire);
+    if (gen != consumerGeneration.load(std::memory_order_relaxed)) {
+        resetConsumer();
+        consumerGeneration.store(gen, std::memory_order_release);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto prev = lastCallback;
+    const size_t prevFrames = lastFrames;
+    lastCallback = now;
+    lastFrames = frames;
+
+    if (!active.load(std::memory_order_acquire))
+        return;
+
+    inc(callbacks);
+    if (underrun)
+        inc(underruns);
+    if (outputUnderflow)
+        inc(outputUnderflows);
+    if (outputOverflow)
+        inc(outputOverflows);
+    const size_t bucket = std::min(fillLevel * FILL_BUCKETS / bufferSize, FILL_BUCKETS - 1);
+    inc(fillHistogram[bucket]);
+
+    // jitter is the deviation of the callback interval from the duration of the previous buffer
+    if (prevFrames > 0) {
+        const double interval = std::chrono::duration<double, std::nano>(now - prev).count();
+        const double expected = double(prevFrames) * 1e9 / sampleRate;
+        const uint64_t jitter = static_cast<uint64_t>(std::abs(interval - expected));
+        inc(jitterSumNs, jitter);
+        inc(jitterCount);
+        if (jitter > jitterMaxNs.load(std::memory_order_relaxed))
+            jitterMaxNs.store(jitter, std::memory_order_relaxed);
+    }
+}
+
+PlaybackStats::Snapshot PlaybackStats::GetSnapshot() const
+{
+    Snapshot s;
+    // the consumer counters are still the ones of the previous run until the first callback
+    const bool consumerCurrent = consumerGeneration.load(std::memory_order_acquire) ==
+        generation.load(std::memory_order_relaxed);
+    if (consumerCurrent) {
+        s.callbacks = callbacks.load(std::memory_order_relaxed);
+        s.underruns = underruns.load(std::memory_order_relaxed);
+        s.outputUnderflows = outputUnderflows.load(std::memory_order_relaxed);
+        s.outputOverflows = outputOverflows.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < FILL_BUCKETS; i++)
+            s.fillHistogram[i] = fillHistogram[i].load(std::memory_order_relaxed);
+    }
+
+    s.microframes = microframes.load(std::memory_order_relaxed);
+    if (s.microframes > 0) {
+        s.renderMinUs = double(renderMinNs.load(std::memory_order_relaxed)) / 1000.0;
+        s.renderAvgUs = double(renderSumNs.load(std::memory_order_relaxed)) / 1000.0 / double(s.microframes);
+        // upper edge of the bucket that contains the 99th percentile
+        const uint64_t rank = s.microframes - s.microframes / 100;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < RENDER_BUCKETS; i++) {
+            seen += renderHistogram[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                s.renderP99Us = double((i + 1) * RENDER_BUCKET_US);
+                break;
+            }
+        }
+    }
+
+    const uint64_t jitters = consumerCurrent ? jitterCount.load(std::memory_order_relaxed) : 0;
+    if (jitters > 0) {
+        s.jitterAvgUs = double(jitterSumNs.load(std::memory_order_relaxed)) / 1000.0 / double(jitters);
+        s.jitterMaxUs = double(jitterMaxNs.load(std::memory_order_relaxed)) / 1000.0;
+    }
+    return s;
+}
+
+/*
+ * private PlaybackStats
+ */
+
+void PlaybackStats::resetConsumer()
+{
+    callbacks.store(0, std::memory_order_relaxed);
+    underruns.store(0, std::memory_order_relaxed);
+    outputUnderflows.store(0, std::memory_order_relaxed);
+    outputOverflows.store(0, std::memory_order_relaxed);
+    for (counter& c : fillHistogram)
+        c.store(0, std::memory_order_relaxed);
+    jitterSumNs.store(0, std::memory_order_relaxed);
+    jitterMaxNs.store(0, std::memory_order_relaxed);
+    jitterCount.store(0, std::memory_order_relaxed);
+    // the interval to the last callback of the previous run isn't jitter
+    lastFrames = 0;
+}
+
+void PlaybackStats::inc(counter& c, uint64_t n)
+{
+    // only one thread writes each counter, so this doesn't need to be a locked RMW
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
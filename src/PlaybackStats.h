@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Counters for live playback. The audio callback (consumer) and the player
+ * thread (producer) each write their own set of counters with relaxed
+ * atomics, so recording never blocks. Any thread may take a snapshot.
+ * Start only resets the producer counters and bumps the generation, the
+ * consumer resets its own counters once it sees a new generation.
+ */
+class PlaybackStats
+{
+public:
+    static const size_t FILL_BUCKETS = 10;      // ring fill level in 10% steps
+    static const size_t RENDER_BUCKETS = 1000;  // render time in RENDER_BUCKET_US steps
+    static const uint32_t RENDER_BUCKET_US = 10;
+
+    struct Snapshot {
+        uint64_t callbacks = 0;
+        uint64_t underruns = 0;         // callbacks that found the ring buffer empty
+        uint64_t outputUnderflows = 0;  // reported by the audio driver
+        uint64_t outputOverflows = 0;
+        std::array<uint64_t, FILL_BUCKETS> fillHistogram{};
+        uint64_t microframes = 0;
+        double renderMinUs = 0.0;
+        double renderAvgUs = 0.0;
+        double renderP99Us = 0.0;
+        double jitterAvgUs = 0.0;
+        double jitterMaxUs = 0.0;
+    };
+
+    PlaybackStats(double sampleRate);
+    PlaybackStats(const PlaybackStats&) = delete;
+    PlaybackStats& operator=(const PlaybackStats&) = delete;
+
+    // producer side
+    void Start();
+    void Stop();
+    void RecordRender(std::chrono::steady_clock::duration renderTime);
+    // consumer side
+    void RecordCallback(size_t fillLevel, size_t bufferSize, size_t frames,
+            bool underrun, bool outputUnderflow, bool outputOverflow);
+
+    Snapshot GetSnapshot() const;
+private:
+    typedef std::atomic<uint64_t> counter;
+    static void inc(counter& c, uint64_t n = 1);
+
+    void resetConsumer();
+
+    const double sampleRate;
+    std::atomic<bool> active{false};
+    std::atomic<uint32_t> generation{0};
+
+    // written by the player thread
+    counter microframes{0};
+    counter renderSumNs{0};
+    counter renderMinNs{0};
+    std::array<counter, RENDER_BUCKETS> renderHistogram{};
+
+    // written by the audio callback
+    std::atomic<uint32_t> consumerGeneration{0};   // generation of the counters below
+    counter callbacks{0};
+    counter underruns{0};
+    counter outputUnderflows{0};
+    counter outputOverflows{0};
+    std::array<counter, FILL_BUCKETS> fillHistogram{};
+    counter jitterSumNs{0};
+    counter jitterMaxNs{0};
+    counter jitterCount{0};
+    std::chrono::steady_clock::time_point lastCallback;
+    size_t lastFrames = 0;
+};
@@ -1,8 +1,13 @@
+#include <algorithm>
+
 #include "PlayerContext.h"
 #include "ConfigManager.h"
 
-PlayerContext::PlayerContext(int8_t maxLoops, uint8_t maxTracks, EnginePars pars)
-    : reader(*this, maxLoops), mixer(*this, STREAM_SAMPLERATE, 1.0f), seq(maxTracks), pars(pars)
+// upper limit of microframes mixed in one go, bounds the resampler's stack buffer
+#define MAX_MICROFRAMES_PER_RUN 16
+
+PlayerContext::PlayerContext(int8_t maxLoops, uint8_t maxTracks, EnginePars pars, uint32_t sampleRate)
+    : reader(*this, maxLoops), mixer(*this, sampleRate, 1.0f), seq(maxTracks), pars(pars)
 {
 }
 
@@ -13,6 +18,77 @@ void PlayerContext::Process(std::vector<std::vector<sample>>& trackAudio)
     curInterFrame++;
 }
 
+/*
+ * Offline rendering: renders up to numMicroframes microframes into trackAudio.
+ * The sequence is still stepped every microframe, but microframes between two
+ * sequencer ticks are mixed as one run. Returns the number of samples which
+ * were rendered before the song ended (check HasEnded() afterwards). Like with
+ * the exporter's microframe loop, the microframe during which the song ends is
+ * not counted.
+ */
+size_t PlayerContext::Render(std::vector<std::vector<sample>>& trackAudio, size_t numMicroframes)
+{
+    trackAudio.resize(seq.tracks.size());
+    for (auto& buffer : trackAudio)
+        buffer.resize(mixer.GetSamplesForMicroframes(numMicroframes));
+
+    size_t rendered = 0;
+    size_t renderedSamples = 0;
+    while (rendered < numMicroframes) {
+        reader.Process();
+
+        size_t run = std::min(numMicroframes - rendered, size_t(MAX_MICROFRAMES_PER_RUN));
+        run = std::min(run, reader.GetMicroframesWithoutTick() + 1);
+        // make sure the run ends exactly when the song does
+        if (reader.EndReached())
+            run = std::min(run, std::max(mixer.GetFadeMicroframesLeft(), size_t(1)));
+        for (size_t i = 1; i < run; i++)
+            reader.Process();
+
+        const size_t runSamples = mixer.GetSamplesForMicroframes(run);
+        const size_t runSamplesWithoutLast = mixer.GetSamplesForMicroframes(run - 1);
+        mixer.Process(trackAudio, renderedSamples, run);
+        curInterFrame += run;
+        rendered += run;
+
+        if (HasEnded())
+            return renderedSamples + runSamplesWithoutLast;
+        renderedSamples += runSamples;
+    }
+    return renderedSamples;
+}
+
+/*
+ * Sequencer only dry run: steps the sequence without mixing anything and
+ * returns how many microframes the song would render for (including the final
+ * fade). Voices are dropped right after they are started, so the context must
+ * be reinitialized with InitSong before it is used for rendering.
+ * Stops at maxMicroframes if the song doesn't end by then. If fadeStart is
+ * given, it receives the number of microframes before the song's own fade out
+ * starts (or maxMicroframes).
+ */
+size_t PlayerContext::EstimateMicroframes(size_t maxMicroframes, size_t *fadeStart)
+{
+    size_t microframes = 0;
+    while (microframes < maxMicroframes && !reader.EndReached()) {
+        reader.Process();
+        sndChannels.clear();
+        sq1Channels.clear();
+        sq2Channels.clear();
+        waveChannels.clear();
+        noiseChannels.clear();
+        microframes++;
+    }
+    if (fadeStart)
+        *fadeStart = reader.EndReached() ? microframes - 1 : maxMicroframes;
+    if (!reader.EndReached())
+        return maxMicroframes;
+    // the fade already starts during the microframe in which the song ends,
+    // and like in Render, the last microframe isn't counted
+    microframes += std::max(mixer.GetFadeMicroframesLeft(), size_t(1)) - 1;
+    return std::min(microframes - 1, maxMicroframes);
+}
+
 void PlayerContext::InitSong(size_t songHeaderPos)
 {
     GameConfig& cfg = ConfigManager::Instance().GetCfg();
@@ -4,6 +4,8 @@
 
 #include "SequenceReader.h"
 #include "SoundMixer.h"
+#include "VoicePool.h"
+#include "WorkerPool.h"
 
 /* Instead of defining lots of global objects, we define
  * a context with all the things we need. So anything which
@@ -11,11 +13,13 @@
  * to a PlayerContext */
 
 struct PlayerContext {
-    PlayerContext(int8_t maxLoops, uint8_t maxTracks, EnginePars pars);
+    PlayerContext(int8_t maxLoops, uint8_t maxTracks, EnginePars pars, uint32_t sampleRate);
     PlayerContext(const PlayerContext&) = delete;
     PlayerContext& operator=(const PlayerContext&) = delete;
 
     void Process(std::vector<std::vector<sample>>& trackAudio);
+    size_t Render(std::vector<std::vector<sample>>& trackAudio, size_t numMicroframes);
+    size_t EstimateMicroframes(size_t maxMicroframes, size_t *fadeStart = nullptr);
     void InitSong(size_t songPos);
     bool HasEnded() const;
     size_t GetCurInterFrame() const;
@@ -26,12 +30,18 @@ struct PlayerContext {
     SoundBank bnk;
     EnginePars pars;
 
+    // recycled resamplers, must be declared before (and thus outlive) the channels
+    ResamplerPool rsPool;
+
     // sound channels
-    std::list<SoundChannel> sndChannels;
-    std::list<SquareChannel> sq1Channels;
-    std::list<SquareChannel> sq2Channels;
-    std::list<WaveChannel> waveChannels;
-    std::list<NoiseChannel> noiseChannels;
+    VoicePool<SoundChannel> sndChannels;
+    VoicePool<SquareChannel> sq1Channels;
+    VoicePool<SquareChannel> sq2Channels;
+    VoicePool<WaveChannel> waveChannels;
+    VoicePool<NoiseChannel> noiseChannels;
 
     size_t curInterFrame = 0;
+
+    // if set, the tracks are mixed in parallel
+    WorkerPool *workerPool = nullptr;
 };
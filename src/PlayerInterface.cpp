@@ -41,6 +41,9 @@ const std::vector<PaHostApiTypeId> PlayerInterface::hostApiPriority = {
 
 PlayerInterface::PlayerInterface(TrackviewGUI& trackUI, size_t initSongPos)
     : trackUI(trackUI),
+    rBuf(ConfigManager::Instance().GetPlaybackBufferSize()),
+    stats(ConfigManager::Instance().GetSampleRate()),
+    masterLoudness(10.0f, ConfigManager::Instance().GetSampleRate()),
     mutedTracks(ConfigManager::Instance().GetCfg().GetTrackLimit())
 {
     initContext();
@@ -227,6 +230,11 @@ SongInfo PlayerInterface::GetSongInfo() const
     return result;
 }
 
+PlaybackStats::Snapshot PlayerInterface::GetPlaybackStats() const
+{
+    return stats.GetSnapshot();
+}
+
 /*
  * private PlayerInterface
  */
@@ -240,16 +248,19 @@ void PlayerInterface::initContext()
     ctx = std::make_unique<PlayerContext>(
             ConfigManager::Instance().GetMaxLoopsPlaylist(),
             cfg.GetTrackLimit(),
-            EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq())
+            EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq()),
+            ConfigManager::Instance().GetSampleRate()
             );
+    // the audio thread must not wait for polyphase banks to be computed
+    ctx->rsPool.SetRealtime(true);
 }
 
 void PlayerInterface::threadWorker()
 {
-    size_t samplesPerBuffer = ctx->mixer.GetSamplesPerBuffer();
-    std::vector<sample> silence(samplesPerBuffer, sample{0.0f, 0.0f});
-    std::vector<sample> masterAudio(samplesPerBuffer, sample{0.0f, 0.0f});
+    std::vector<sample> silence(ctx->mixer.GetSamplesForMicroframes(1), sample{0.0f, 0.0f});
+    std::vector<sample> masterAudio;
     std::vector<std::vector<sample>> trackAudio;
+    stats.Start();
     try {
         while (playerState != State::SHUTDOWN) {
             switch (playerState) {
@@ -259,8 +270,10 @@ void PlayerInterface::threadWorker()
                 [[fallthrough]];
             case State::PLAYING:
                 {
-                    // clear high level mixing buffer
-                    fill(masterAudio.begin(), masterAudio.end(), sample{0.0f, 0.0f});
+                    const auto renderStart = std::chrono::steady_clock::now();
+                    // clear high level mixing buffer, the microframe length may vary by a sample
+                    const size_t samplesPerBuffer = ctx->mixer.GetSamplesForMicroframes(1);
+                    masterAudio.assign(samplesPerBuffer, sample{0.0f, 0.0f});
                     // render audio buffers for tracks
                     ctx->Process(trackAudio);
                     for (size_t i = 0; i < trackAudio.size(); i++) {
@@ -277,6 +290,7 @@ void PlayerInterface::threadWorker()
                             masterAudio[j].right += trackAudio[i][j].right;
                         }
                     }
+                    stats.RecordRender(std::chrono::steady_clock::now() - renderStart);
                     // blocking write to audio buffer
                     rBuf.Put(masterAudio.data(), masterAudio.size());
                     masterLoudness.CalcLoudness(masterAudio.data(), samplesPerBuffer);
@@ -302,6 +316,7 @@ void PlayerInterface::threadWorker()
     for (LoudnessCalculator& c : trackLoudness)
         c.Reset();
     // flush buffer
+    stats.Stop();
     rBuf.Clear();
     playerState = State::TERMINATED;
 }
@@ -311,9 +326,11 @@ int PlayerInterface::audioCallback(const void *inputBuffer, void *outputBuffer,
 {
     (void)inputBuffer;
     (void)timeInfo;
-    (void)statusFlags;
-    Ringbuffer *rBuf = (Ringbuffer *)userData;
-    rBuf->Take((sample *)outputBuffer, framesPerBuffer);
+    PlayerInterface *player = (PlayerInterface *)userData;
+    const size_t fillLevel = player->rBuf.GetFillLevel();
+    const bool ok = player->rBuf.Take((sample *)outputBuffer, framesPerBuffer);
+    player->stats.RecordCallback(fillLevel, player->rBuf.GetSize(), framesPerBuffer, !ok,
+            statusFlags & paOutputUnderflow, statusFlags & paOutputOverflow);
     return 0;
 }
 
@@ -321,7 +338,7 @@ void PlayerInterface::setupLoudnessCalcs()
 {
     trackLoudness.clear();
     for (size_t i = 0; i < ctx->seq.tracks.size(); i++)
-        trackLoudness.emplace_back(5.0f);
+        trackLoudness.emplace_back(5.0f, ctx->mixer.GetSampleRate());
 }
 
 void PlayerInterface::portaudioOpen()
@@ -377,7 +394,7 @@ void PlayerInterface::portaudioOpen()
         outputStreamParameters.hostApiSpecificStreamInfo = hostApiSpecificStreamInfo.get();
 
         const uint32_t rate = ctx->mixer.GetSampleRate();
-        PaError err = Pa_OpenStream(&audioStream, nullptr, &outputStreamParameters, rate, paFramesPerBufferUnspecified, paNoFlag, audioCallback, (void *)&rBuf);
+        PaError err = Pa_OpenStream(&audioStream, nullptr, &outputStreamParameters, rate, paFramesPerBufferUnspecified, paNoFlag, audioCallback, (void *)this);
         if (err != paNoError) {
             Debug::print("Pa_OpenStream(): unable to open stream with host API %s: %s", apiInfo->name, Pa_GetErrorText(err));
             continue;
@@ -13,6 +13,7 @@
 #include "Ringbuffer.h"
 #include "LoudnessCalculator.h"
 #include "PlayerContext.h"
+#include "PlaybackStats.h"
 
 class PlayerInterface 
 {
@@ -36,6 +37,7 @@ public:
     size_t GetMaxTracks() { return mutedTracks.size(); }
     void GetMasterVolLevels(float& left, float& right);
     SongInfo GetSongInfo() const;
+    PlaybackStats::Snapshot GetPlaybackStats() const;
 
 private:
     void initContext();
@@ -57,9 +59,10 @@ private:
     } playerState = State::THREAD_DELETED;
     std::unique_ptr<PlayerContext> ctx;
     TrackviewGUI& trackUI;
-    Ringbuffer rBuf{STREAM_BUF_SIZE};
+    Ringbuffer rBuf;
+    PlaybackStats stats;
 
-    LoudnessCalculator masterLoudness{10.0f};
+    LoudnessCalculator masterLoudness;
     std::vector<LoudnessCalculator> trackLoudness;
     std::vector<bool> mutedTracks;
 
@@ -0,0 +1,38 @@
+#include <atomic>
+
+#include "Profiler.h"
+
+// relaxed atomics, the tracks may be mixed on several threads
+static std::array<std::atomic<uint64_t>, static_cast<size_t>(ProfileStage::COUNT)> totals;
+
+const char *Profiler::GetStageName(ProfileStage stage)
+{
+    switch (stage) {
+    case ProfileStage::SEQUENCER: return "sequencer";
+    case ProfileStage::PCM_NEAREST: return "pcm-nearest";
+    case ProfileStage::PCM_LINEAR: return "pcm-linear";
+    case ProfileStage::PCM_SINC: return "pcm-sinc";
+    case ProfileStage::PCM_BLEP: return "pcm-blep";
+    case ProfileStage::PCM_BLAMP: return "pcm-blamp";
+    case ProfileStage::PCM_SYNTH: return "pcm-synth";
+    case ProfileStage::CGB: return "cgb";
+    case ProfileStage::REVERB: return "reverb";
+    case ProfileStage::FADE: return "fade";
+    case ProfileStage::LOUDNESS: return "loudness";
+    case ProfileStage::COUNT: break;
+    }
+    return "?";
+}
+
+void Profiler::Add(ProfileStage stage, uint64_t nanoseconds)
+{
+    totals[static_cast<size_t>(stage)].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+Profiler::Totals Profiler::TakeTotals()
+{
+    Totals result;
+    for (size_t i = 0; i < result.size(); i++)
+        result[i] = totals[i].exchange(0, std::memory_order_relaxed);
+    return result;
+}
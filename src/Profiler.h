@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Accumulates the time spent in the stages of the engine. The timers are only
+ * compiled in with -DAGBPLAY_PROFILE (used by "make bench"), otherwise
+ * PROFILE_SCOPE does nothing and the player isn't slowed down. Stages don't
+ * nest, so the times of all stages add up.
+ */
+enum class ProfileStage : size_t {
+    SEQUENCER = 0,
+    PCM_NEAREST, PCM_LINEAR, PCM_SINC, PCM_BLEP, PCM_BLAMP, PCM_SYNTH,
+    CGB,
+    REVERB,
+    FADE,
+    LOUDNESS,
+    COUNT
+};
+
+namespace Profiler {
+    typedef std::array<uint64_t, static_cast<size_t>(ProfileStage::COUNT)> Totals;
+
+    const char *GetStageName(ProfileStage stage);
+    void Add(ProfileStage stage, uint64_t nanoseconds);
+    // returns the nanoseconds spent in each stage since the last call
+    Totals TakeTotals();
+};
+
+#ifdef AGBPLAY_PROFILE
+class ProfileScope
+{
+public:
+    ProfileScope(ProfileStage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~ProfileScope()
+    {
+        auto end = std::chrono::steady_clock::now();
+        Profiler::Add(stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    }
+private:
+    ProfileStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(stage)
+#else
+#define PROFILE_SCOPE(stage) do {} while (0)
+#endif
@@ -0,0 +1,138 @@
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <system_error>
+
+#include "RenderCache.h"
+#include "ConfigManager.h"
+#include "Rom.h"
+#include "Util.h"
+#include "Debug.h"
+#include "OS.h"
+
+// increase this whenever a change in agbplay changes the exported audio
+#define RENDER_CACHE_VERSION 3
+
+/*
+ * public RenderCache
+ */
+
+RenderCache::RenderCache(const std::filesystem::path& dir)
+    : dir(dir)
+{
+}
+
+std::string RenderCache::MakeKey(size_t songPos, bool separate)
+{
+    const ConfigManager& cm = ConfigManager::Instance();
+    const GameConfig& cfg = cm.GetCfg();
+
+    std::ostringstream key;
+    key << "agbplay render cache " << RENDER_CACHE_VERSION << "\n"
+        << "rom " << std::hex << std::setw(16) << std::setfill('0') << Rom::Instance().GetHash() << std::dec << "\n"
+        << "song " << songPos << "\n"
+        << "separate " << separate << "\n"
+        << "samplerate " << cm.GetSampleRate() << "\n"
+        << "cgb-polyphony " << cgbPoly2str(cm.GetCgbPolyphony()) << "\n"
+        << "max-loops-export " << int(cm.GetMaxLoopsExport()) << "\n"
+        << "pad-seconds-start " << cm.GetPadSecondsStart() << "\n"
+        << "pad-seconds-end " << cm.GetPadSecondsEnd() << "\n"
+        << "export-format " << exportFmt2str(cm.GetExportFormat()) << "\n"
+        << "export-flac-compression-level " << cm.GetFlacCompressionLevel() << "\n"
+        << "export-vorbis-quality " << cm.GetVorbisQuality() << "\n"
+        << "export-opus-quality " << cm.GetOpusQuality() << "\n"
+        << "export-dither " << cm.GetExportDither() << "\n"
+        << "pcm-master-volume " << int(cfg.GetPCMVol()) << "\n"
+        << "pcm-samplerate " << int(cfg.GetEngineFreq()) << "\n"
+        << "pcm-reverb-level " << int(cfg.GetEngineRev()) << "\n"
+        << "pcm-reverb-buffer-len " << cfg.GetRevBufSize() << "\n"
+        << "pcm-reverb-type " << rev2str(cfg.GetRevType()) << "\n"
+        << "pcm-resampling-algo " << res2str(cfg.GetResType()) << "\n"
+        << "pcm-fixed-rate-resampling-algo " << res2str(cfg.GetResTypeFixed()) << "\n"
+        << "song-track-limit " << int(cfg.GetTrackLimit()) << "\n"
+        << "accurate-ch3-volume " << cfg.GetAccurateCh3Volume() << "\n"
+        << "accurate-ch3-quantization " << cfg.GetAccurateCh3Quantization() << "\n"
+        << "simulate-cgb-sustain-bug " << cfg.GetSimulateCGBSustainBug() << "\n";
+    return key.str();
+}
+
+bool RenderCache::Restore(const std::string& key, const std::filesystem::path& fileName,
+        std::vector<std::filesystem::path>& files, size_t& samples)
+{
+    const std::filesystem::path entry = entryDir(key);
+
+    /* the entry file is written last, so entries without it are incomplete,
+     * it also contains the full key to rule out hash collisions */
+    std::ifstream entryFile(entry / "entry.txt");
+    if (!entryFile.is_open())
+        return false;
+    std::stringstream content;
+    content << entryFile.rdbuf();
+    const std::string text = content.str();
+    if (text.compare(0, key.size(), key) != 0)
+        return false;
+    std::istringstream rest(text.substr(key.size()));
+    std::string field;
+    if (!(rest >> field >> samples) || field != "samples")
+        return false;
+
+    files.clear();
+    std::error_code ec;
+    for (const auto& cached : std::filesystem::directory_iterator(entry, ec)) {
+        const std::string name = cached.path().filename().string();
+        if (name.compare(0, 4, "song") != 0)
+            continue;
+        files.emplace_back(fileName.string() + name.substr(4));
+        if (!copyFile(cached.path(), files.back()))
+            return false;
+    }
+    return !files.empty();
+}
+
+void RenderCache::Store(const std::string& key, const std::filesystem::path& fileName,
+        const std::vector<std::filesystem::path>& files, size_t samples)
+{
+    const std::filesystem::path entry = entryDir(key);
+    const std::string prefix = fileName.string();
+
+    std::error_code ec;
+    std::filesystem::remove_all(entry, ec);
+    if (!std::filesystem::create_directories(entry, ec)) {
+        Debug::print("Render cache: creating %s failed: %s", entry.string().c_str(), ec.message().c_str());
+        return;
+    }
+    for (const std::filesystem::path& file : files) {
+        const std::string name = file.string();
+        if (name.compare(0, prefix.size(), prefix) != 0 || !copyFile(file, entry / ("song" + name.substr(prefix.size())))) {
+            std::filesystem::remove_all(entry, ec);
+            return;
+        }
+    }
+
+    std::ofstream entryFile(entry / "entry.txt");
+    entryFile << key << "samples " << samples << "\n";
+}
+
+/*
+ * private RenderCache
+ */
+
+std::filesystem::path RenderCache::entryDir(const std::string& key) const
+{
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << Fnv1a64(key.data(), key.size());
+    return dir / name.str();
+}
+
+bool RenderCache::copyFile(const std::filesystem::path& from, const std::filesystem::path& to)
+{
+    std::error_code ec;
+    std::filesystem::remove(to, ec);
+    if (OS::CloneFile(from, to))
+        return true;
+    std::filesystem::copy_file(from, to, ec);
+    if (!ec)
+        return true;
+    Debug::print("Render cache: %s -> %s failed: %s", from.string().c_str(), to.string().c_str(), ec.message().c_str());
+    return false;
+}
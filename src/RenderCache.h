@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <filesystem>
+
+/*
+ * On-disk cache of exported songs. Each entry is a directory named after a
+ * hash of its key, which describes everything that affects the output (ROM
+ * content, song, engine and export settings). Entries hold copies of the
+ * exported files, never links, so changing an export doesn't change the cache
+ * and vice versa. Where the file system supports it (e.g. Btrfs, XFS), the
+ * copies are reflinks that share the data until either side is modified.
+ */
+class RenderCache
+{
+public:
+    RenderCache(const std::filesystem::path& dir);
+
+    // key for a song with the current ROM and settings
+    static std::string MakeKey(size_t songPos, bool separate);
+
+    // on success, files contains the restored files
+    bool Restore(const std::string& key, const std::filesystem::path& fileName,
+            std::vector<std::filesystem::path>& files, size_t& samples);
+    // all files have to start with fileName
+    void Store(const std::string& key, const std::filesystem::path& fileName,
+            const std::vector<std::filesystem::path>& files, size_t samples);
+private:
+    std::filesystem::path entryDir(const std::string& key) const;
+    static bool copyFile(const std::filesystem::path& from, const std::filesystem::path& to);
+
+    std::filesystem::path dir;
+};
@@ -1,4 +1,19 @@
 #include <boost/math/special_functions/sinc.hpp>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLER_X86_SIMD
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RESAMPLER_NEON_SIMD
+#include <arm_neon.h>
+#endif
 
 #include "Resampler.h"
 #include "Util.h"
@@ -8,17 +23,29 @@ Resampler::~Resampler()
 {
 }
 
-bool Resampler::ResamplerChainSampleFetchCB(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata)
+// initial fetch buffer capacity, enough for a couple of blocks at typical pitches
+#define FETCH_BUFFER_SIZE 2048
+
+void Resampler::makeRoom(size_t samplesRequired)
 {
-    if (fetchBuffer.size() >= samplesRequired)
-        return true;
-    ResamplerChainData *chainData = static_cast<ResamplerChainData *>(cbdata);
-    size_t samplesToFetch = samplesRequired - fetchBuffer.size();
-    size_t i = fetchBuffer.size();
-    fetchBuffer.resize(samplesRequired);
+    // move the remaining history to the front, this happens once every few blocks
+    size_t samplesAvailable = writePos - readPos;
+    std::copy(fetchBuffer.begin() + static_cast<ptrdiff_t>(readPos),
+            fetchBuffer.begin() + static_cast<ptrdiff_t>(writePos), fetchBuffer.begin());
+    readPos = 0;
+    writePos = samplesAvailable;
+    // only very high pitches request more than the buffer can ever hold
+    if (samplesRequired > fetchBuffer.size())
+        fetchBuffer.resize(samplesRequired * 2);
+}
 
-    return chainData->_this->Process(&fetchBuffer[i], samplesToFetch,
-            chainData->phaseInc, chainData->cbPtr, chainData->cbdata);
+void Resampler::resetBuffer(size_t history)
+{
+    if (fetchBuffer.size() < FETCH_BUFFER_SIZE)
+        fetchBuffer.resize(FETCH_BUFFER_SIZE);
+    std::fill(fetchBuffer.begin(), fetchBuffer.begin() + static_cast<ptrdiff_t>(history), 0.0f);
+    readPos = 0;
+    writePos = history;
 }
 
 NearestResampler::NearestResampler()
@@ -32,35 +59,14 @@ NearestResampler::~NearestResampler()
 
 void NearestResampler::Reset()
 {
-    fetchBuffer.clear();
+    resetBuffer(0);
     phase = 0.0f;
 }
 
 bool NearestResampler::Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata)
 {
-    if (numBlocks == 0)
-        return true;
-
-    size_t samplesRequired = size_t(phase + phaseInc * static_cast<float>(numBlocks));
-    // be sure and fetch one more sample in case of odd rounding errors
-    samplesRequired += 1;
-    bool result = cbPtr(fetchBuffer, samplesRequired, cbdata);
-
-    int i = 0;
-    do {
-        float sample = fetchBuffer[i];
-        phase += phaseInc;
-        int istep = static_cast<int>(phase);
-        phase -= static_cast<float>(istep);
-        i += istep;
-
-        *outData++ = sample;
-    } while (--numBlocks > 0);
-
-    // remove first i elements from the fetch buffer since they are no longer needed
-    fetchBuffer.erase(fetchBuffer.begin(), fetchBuffer.begin() + i);
-
-    return result;
+    CallbackFetchSource src{cbPtr, cbdata};
+    return ProcessT(outData, numBlocks, phaseInc, src);
 }
 
 LinearResampler::LinearResampler()
@@ -74,40 +80,14 @@ LinearResampler::~LinearResampler()
 
 void LinearResampler::Reset()
 {
-    fetchBuffer.clear();
+    resetBuffer(0);
     phase = 0.0f;
 }
 
 bool LinearResampler::Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata)
 {
-    if (numBlocks == 0)
-        return true;
-
-    size_t samplesRequired = static_cast<size_t>(
-            phase + phaseInc * static_cast<float>(numBlocks));
-    // be sure and fetch one more sample in case of odd rounding errors
-    samplesRequired += 1;
-    // fetch one more for linear interpolation
-    samplesRequired += 1;
-    bool result = cbPtr(fetchBuffer, samplesRequired, cbdata);
-
-    int i = 0;
-    do {
-        float a = fetchBuffer[i];
-        float b = fetchBuffer[i+1];
-        float sample = a + phase * (b - a);
-        phase += phaseInc;
-        int istep = static_cast<int>(phase);
-        phase -= static_cast<float>(istep);
-        i += istep;
-
-        *outData++ = sample;
-    } while (--numBlocks > 0);
-
-    // remove first i elements from the fetch buffer since they are no longer needed
-    fetchBuffer.erase(fetchBuffer.begin(), fetchBuffer.begin() + i);
-
-    return result;
+    CallbackFetchSource src{cbPtr, cbdata};
+    return ProcessT(outData, numBlocks, phaseInc, src);
 }
 
 //static float triangle(float t)
@@ -122,74 +102,419 @@ bool LinearResampler::Process(float *outData, size_t numBlocks, float phaseInc,
 //        return 0.0f;
 //}
 
-#define SINC_WINDOW_SIZE 16
-#define SINC_FILT_THRESH 0.85f
+/*
+ * polyphase kernel tables
+ */
 
-SincResampler::SincResampler()
+// number of precomputed phases, output is linearly interpolated in between
+#define POLYPHASE_PHASES 256
+// kernels steeper than one sample (BLEP upsampling) get proportionally more phases
+#define POLYPHASE_MAX_OVERSAMPLING 4
+// number of cutoff bands per octave, kernels in between are interpolated
+#define POLYPHASE_BANDS_PER_OCTAVE 48
+#define POLYPHASE_BAND_LIMIT (POLYPHASE_BANDS_PER_OCTAVE * 10)
+// one band per octave up to this far from band 0 is computed right at startup
+#define POLYPHASE_PRECOMPUTED_OCTAVES 4
+#define POLYPHASE_TAPS (SINC_WINDOW_SIZE * 2)
+// limit for the size of all computed banks together
+#define POLYPHASE_CACHE_SIZE (64 * 1024 * 1024)
+
+PolyphaseBank::PolyphaseBank(kernel_func kernel, float sincStep)
+    : kernel(kernel), sincStep(sincStep)
 {
-    Reset();
+    float oversampling = std::min(ceilf(sincStep), float(POLYPHASE_MAX_OVERSAMPLING));
+    phases = POLYPHASE_PHASES * std::max(static_cast<size_t>(oversampling), size_t(1));
+    kernels.resize((phases + 1) * POLYPHASE_TAPS);
+
+    for (size_t p = 0; p <= phases; p++) {
+        float phase = float(p) / float(phases);
+        float *k = &kernels[p * POLYPHASE_TAPS];
+        float kernelSum = 0.0f;
+        for (int wi = -SINC_WINDOW_SIZE + 1; wi <= SINC_WINDOW_SIZE; wi++) {
+            float v = kernel(float(wi) - phase, sincStep);
+            k[wi + SINC_WINDOW_SIZE - 1] = v;
+            kernelSum += v;
+        }
+        // normalize here so Process doesn't have to divide by the kernel sum
+        for (size_t t = 0; t < POLYPHASE_TAPS; t++)
+            k[t] /= kernelSum;
+    }
 }
 
-SincResampler::~SincResampler()
+float PolyphaseBank::ConvolveDirect(const float *data, float phase) const
 {
+    float sampleSum = 0.0f;
+    float kernelSum = 0.0f;
+    for (int wi = -SINC_WINDOW_SIZE + 1; wi <= SINC_WINDOW_SIZE; wi++) {
+        float v = kernel(float(wi) - phase, sincStep);
+        sampleSum += v * data[wi + SINC_WINDOW_SIZE - 1];
+        kernelSum += v;
+    }
+    return sampleSum / kernelSum;
 }
 
-void SincResampler::Reset()
+size_t PolyphaseBank::GetSize() const
 {
-    fetchBuffer.clear();
-    fetchBuffer.resize(SINC_WINDOW_SIZE, 0.0f);
-    phase = 0.0f;
+    return sizeof(*this) + kernels.size() * sizeof(float);
 }
 
-bool SincResampler::Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata)
+/*
+ * Computes the requested banks of all sets on a background thread. The audio
+ * thread only marks a band as requested and wakes the builder, it never takes
+ * the mutex.
+ */
+class PolyphaseBankBuilder {
+public:
+    PolyphaseBankBuilder();
+    ~PolyphaseBankBuilder();
+    PolyphaseBankBuilder(const PolyphaseBankBuilder&) = delete;
+    PolyphaseBankBuilder& operator=(const PolyphaseBankBuilder&) = delete;
+
+    void Add(PolyphaseBankSet *set);
+    void Remove(PolyphaseBankSet *set);
+    void Request();
+    const PolyphaseBank *ComputeNow(PolyphaseBankSet& set, size_t i);
+private:
+    void run();
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<bool> pending{false};
+    bool quit = false;
+    size_t bankBytes = 0;
+    std::vector<PolyphaseBankSet *> sets;
+    std::thread thread;
+};
+
+PolyphaseBankBuilder::PolyphaseBankBuilder()
 {
-    if (numBlocks == 0)
-        return true;
+    thread = std::thread(&PolyphaseBankBuilder::run, this);
+}
 
-    size_t samplesRequired = static_cast<size_t>(
-            phase + phaseInc * static_cast<float>(numBlocks));
-    // be sure and fetch one more sample in case of odd rounding errors
-    samplesRequired += 1;
-    // fetch a few more for complete windowed sinc interpolation
-    samplesRequired += SINC_WINDOW_SIZE * 2;
-    bool result = cbPtr(fetchBuffer, samplesRequired, cbdata);
+PolyphaseBankBuilder::~PolyphaseBankBuilder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
 
-    float sincStep = phaseInc > SINC_FILT_THRESH ? SINC_FILT_THRESH / phaseInc : 1.00f;
-    //float sincStep = 1.0;
+void PolyphaseBankBuilder::Add(PolyphaseBankSet *set)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        sets.push_back(set);
+    }
+    Request();
+}
 
-    //_print_debug("phaseInc=%f sincStep=%f", phaseInc, sincStep);
+void PolyphaseBankBuilder::Remove(PolyphaseBankSet *set)
+{
+    // waits for a set which is being computed
+    std::lock_guard<std::mutex> lock(mtx);
+    sets.erase(std::remove(sets.begin(), sets.end(), set), sets.end());
+}
 
-    int i = 0;
-    do {
-        float sampleSum = 0.0f;
-        float kernelSum = 0.0f;
-        for (int wi = -SINC_WINDOW_SIZE + 1; wi <= SINC_WINDOW_SIZE; wi++) {
-            float sincIndex = (float(wi) - phase) * sincStep;
-            float windowIndex = float(wi) - phase;
-            //_print_debug("wi=%zu phase=%f sincStep=%f sincIndex=%f", wi, phase, sincStep, sincIndex);
-            float s = fast_sincf(sincIndex);
-            float w = window_func(windowIndex);
-            //float s = triangle(sincIndex);
-            //float w = 1.0f;
-            float kernel = s * w;
-            sampleSum += kernel * fetchBuffer[i + wi + SINC_WINDOW_SIZE - 1];
-            kernelSum += kernel;
-            //_print_debug("s=%f w=%f fetchBuffer[i + wi]=%f", s, w, fetchBuffer[i + wi]);
+void PolyphaseBankBuilder::Request()
+{
+    pending.store(true, std::memory_order_release);
+    cv.notify_one();
+}
+
+const PolyphaseBank *PolyphaseBankBuilder::ComputeNow(PolyphaseBankSet& set, size_t i)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return set.computeBank(i, bankBytes);
+}
+
+void PolyphaseBankBuilder::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!quit) {
+        /* Request doesn't take the mutex, so it may set the flag after it was
+         * checked but before the wait starts and the wakeup is lost. Waking up
+         * once in a while catches these. */
+        if (!pending.exchange(false, std::memory_order_acquire)) {
+            cv.wait_for(lock, std::chrono::milliseconds(250));
+            continue;
         }
-        //_print_debug("sum=%f", sum);
-        phase += phaseInc;
-        int istep = static_cast<int>(phase);
-        phase -= static_cast<float>(istep);
-        i += istep;
+        for (PolyphaseBankSet *set : sets)
+            set->computeRequested(bankBytes);
+    }
+}
+
+// constructed before the sets, so it is destroyed after them
+static PolyphaseBankBuilder bankBuilder;
+
+PolyphaseBankSet::PolyphaseBankSet(PolyphaseBank::kernel_func kernel, int minBand)
+    : kernel(kernel), minBand(minBand),
+    banks(static_cast<size_t>(POLYPHASE_BAND_LIMIT - minBand + 1)),
+    states(banks.size()), ownedBanks(banks.size())
+{
+    for (size_t i = 0; i < banks.size(); i++) {
+        banks[i].store(nullptr, std::memory_order_relaxed);
+        states[i].store(BANK_MISSING, std::memory_order_relaxed);
+    }
+
+    // band 0 is the fallback until the others are computed, so it always exists
+    size_t i0 = index(0);
+    ownedBanks[i0] = Compute(0);
+    banks[i0].store(ownedBanks[i0].get(), std::memory_order_release);
+    states[i0].store(BANK_DONE, std::memory_order_relaxed);
+
+    // one band per octave around it, so the fallback is never far off
+    const int precomputed = POLYPHASE_PRECOMPUTED_OCTAVES * POLYPHASE_BANDS_PER_OCTAVE;
+    for (int band = std::max(minBand, -precomputed); band <= precomputed; band += POLYPHASE_BANDS_PER_OCTAVE) {
+        if (band != 0)
+            states[index(band)].store(BANK_REQUESTED, std::memory_order_relaxed);
+    }
+    bankBuilder.Add(this);
+}
+
+PolyphaseBankSet::~PolyphaseBankSet()
+{
+    bankBuilder.Remove(this);
+}
+
+void PolyphaseBankSet::GetBand(float sincStep, int& band, float& fraction)
+{
+    float pos = -log2f(sincStep) * float(POLYPHASE_BANDS_PER_OCTAVE);
+    // also catches inf and nan from a zero phaseInc
+    if (!(pos > -float(POLYPHASE_BAND_LIMIT)))
+        pos = -float(POLYPHASE_BAND_LIMIT);
+    if (!(pos < float(POLYPHASE_BAND_LIMIT)))
+        pos = float(POLYPHASE_BAND_LIMIT);
+    // the last band is only ever the upper one
+    band = std::min(static_cast<int>(floorf(pos)), POLYPHASE_BAND_LIMIT - 1);
+    fraction = pos - float(band);
+}
+
+const PolyphaseBank *PolyphaseBankSet::GetBank(int band, bool& final)
+{
+    const size_t bi = index(band);
+    const PolyphaseBank *bank = banks[bi].load(std::memory_order_acquire);
+    final = true;
+    if (bank)
+        return bank;
+
+    uint8_t state = BANK_MISSING;
+    if (states[bi].compare_exchange_strong(state, BANK_REQUESTED, std::memory_order_relaxed))
+        bankBuilder.Request();
+    // a denied bank is never computed, the closest band is as good as it gets
+    final = state == BANK_DENIED;
+
+    // closest band which is computed, band 0 always is
+    for (size_t d = 1; ; d++) {
+        if (bi >= d && (bank = banks[bi - d].load(std::memory_order_acquire)) != nullptr)
+            return bank;
+        if (bi + d < banks.size() && (bank = banks[bi + d].load(std::memory_order_acquire)) != nullptr)
+            return bank;
+    }
+}
+
+const PolyphaseBank *PolyphaseBankSet::WaitForBank(int band)
+{
+    const size_t bi = index(band);
+    const PolyphaseBank *bank = banks[bi].load(std::memory_order_acquire);
+    if (bank)
+        return bank;
+    return bankBuilder.ComputeNow(*this, bi);
+}
+
+std::unique_ptr<PolyphaseBank> PolyphaseBankSet::Compute(int band) const
+{
+    float sincStep = exp2f(-float(band) / float(POLYPHASE_BANDS_PER_OCTAVE));
+    return std::make_unique<PolyphaseBank>(kernel, sincStep);
+}
+
+size_t PolyphaseBankSet::index(int band) const
+{
+    return static_cast<size_t>(std::clamp(band, minBand, POLYPHASE_BAND_LIMIT) - minBand);
+}
+
+const PolyphaseBank *PolyphaseBankSet::computeBank(size_t i, size_t& bankBytes)
+{
+    switch (states[i].load(std::memory_order_relaxed)) {
+    case BANK_DONE:
+        return ownedBanks[i].get();
+    case BANK_DENIED:
+        return nullptr;
+    default:
+        break;
+    }
+    if (bankBytes >= POLYPHASE_CACHE_SIZE) {
+        states[i].store(BANK_DENIED, std::memory_order_relaxed);
+        return nullptr;
+    }
+    ownedBanks[i] = Compute(static_cast<int>(i) + minBand);
+    bankBytes += ownedBanks[i]->GetSize();
+    banks[i].store(ownedBanks[i].get(), std::memory_order_release);
+    states[i].store(BANK_DONE, std::memory_order_relaxed);
+    return ownedBanks[i].get();
+}
+
+void PolyphaseBankSet::computeRequested(size_t& bankBytes)
+{
+    for (size_t i = 0; i < banks.size(); i++) {
+        if (states[i].load(std::memory_order_relaxed) == BANK_REQUESTED)
+            computeBank(i, bankBytes);
+    }
+}
+
+/*
+ * Convolution kernels: each computes the dot products of the data window with
+ * two adjacent phase kernels and interpolates between them. The vectorized
+ * versions sum in a different order and may differ from the scalar one in the
+ * last few bits.
+ */
+
+static float convolve_scalar(const float *ka, const float *data, float fraction)
+{
+    const float *kb = ka + POLYPHASE_TAPS;
+    float sumA = 0.0f;
+    float sumB = 0.0f;
+    for (size_t t = 0; t < POLYPHASE_TAPS; t++) {
+        sumA += ka[t] * data[t];
+        sumB += kb[t] * data[t];
+    }
+    return sumA + fraction * (sumB - sumA);
+}
+
+#if defined(RESAMPLER_X86_SIMD)
+
+__attribute__((target("sse")))
+static float convolve_sse(const float *ka, const float *data, float fraction)
+{
+    const float *kb = ka + POLYPHASE_TAPS;
+    __m128 sumA = _mm_setzero_ps();
+    __m128 sumB = _mm_setzero_ps();
+    for (size_t t = 0; t < POLYPHASE_TAPS; t += 4) {
+        __m128 d = _mm_loadu_ps(&data[t]);
+        sumA = _mm_add_ps(sumA, _mm_mul_ps(_mm_loadu_ps(&ka[t]), d));
+        sumB = _mm_add_ps(sumB, _mm_mul_ps(_mm_loadu_ps(&kb[t]), d));
+    }
+    // sumA + fraction * (sumB - sumA), then horizontal add
+    __m128 v = _mm_add_ps(sumA, _mm_mul_ps(_mm_set1_ps(fraction), _mm_sub_ps(sumB, sumA)));
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 0x55));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("avx2,fma")))
+static float convolve_avx2(const float *ka, const float *data, float fraction)
+{
+    const float *kb = ka + POLYPHASE_TAPS;
+    __m256 sumA = _mm256_setzero_ps();
+    __m256 sumB = _mm256_setzero_ps();
+    for (size_t t = 0; t < POLYPHASE_TAPS; t += 8) {
+        __m256 d = _mm256_loadu_ps(&data[t]);
+        sumA = _mm256_fmadd_ps(_mm256_loadu_ps(&ka[t]), d, sumA);
+        sumB = _mm256_fmadd_ps(_mm256_loadu_ps(&kb[t]), d, sumB);
+    }
+    __m256 v = _mm256_fmadd_ps(_mm256_set1_ps(fraction), _mm256_sub_ps(sumB, sumA), sumA);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 0x55));
+    return _mm_cvtss_f32(h);
+}
+
+#elif defined(RESAMPLER_NEON_SIMD)
+
+static float convolve_neon(const float *ka, const float *data, float fraction)
+{
+    const float *kb = ka + POLYPHASE_TAPS;
+    float32x4_t sumA = vdupq_n_f32(0.0f);
+    float32x4_t sumB = vdupq_n_f32(0.0f);
+    for (size_t t = 0; t < POLYPHASE_TAPS; t += 4) {
+        float32x4_t d = vld1q_f32(&data[t]);
+        sumA = vfmaq_f32(sumA, vld1q_f32(&ka[t]), d);
+        sumB = vfmaq_f32(sumB, vld1q_f32(&kb[t]), d);
+    }
+    float32x4_t v = vfmaq_n_f32(sumA, vsubq_f32(sumB, sumA), fraction);
+    return vaddvq_f32(v);
+}
+
+#endif
 
-        *outData++ = sampleSum / kernelSum;
-        //*outData++ = sampleSum;
-        //_print_debug("kernel sum: %f\n", kernelSum);
-    } while (--numBlocks > 0);
-    // remove first i elements from the fetch buffer since they are no longer needed
-    fetchBuffer.erase(fetchBuffer.begin(), fetchBuffer.begin() + i);
+std::vector<PolyphaseBank::ConvolveImpl> PolyphaseBank::GetConvolveImpls()
+{
+    std::vector<ConvolveImpl> impls{{"scalar", convolve_scalar}};
+#if defined(RESAMPLER_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse"))
+        impls.push_back({"sse", convolve_sse});
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        impls.push_back({"avx2", convolve_avx2});
+#elif defined(RESAMPLER_NEON_SIMD)
+    impls.push_back({"neon", convolve_neon});
+#endif
+    return impls;
+}
+
+// the last implementation is the fastest
+static const PolyphaseBank::convolve_func convolve = PolyphaseBank::GetConvolveImpls().back().func;
+
+float PolyphaseBank::Convolve(const float *data, float phase) const
+{
+    float pos = phase * float(phases);
+    size_t p = std::min(static_cast<size_t>(pos), phases - 1);
+    float fraction = pos - static_cast<float>(p);
+    return convolve(&kernels[p * POLYPHASE_TAPS], data, fraction);
+}
 
-    return result;
+PolyphaseResampler::PolyphaseResampler(ResamplerType type)
+    : banks(PolyphaseBankSet::Get(type)), bankLo(nullptr), bankHi(nullptr),
+    bankBand(std::numeric_limits<int>::min())
+{
+    Reset();
+}
+
+void PolyphaseResampler::selectBanks(int band)
+{
+    bool final = true;
+    bankLo = selectBank(band, ownBankLo, final);
+    bankHi = selectBank(band + 1, ownBankHi, final);
+    // look again next block until the banks of these bands are computed
+    bankBand = final ? band : std::numeric_limits<int>::min();
+}
+
+const PolyphaseBank *PolyphaseResampler::selectBank(int band, std::unique_ptr<const PolyphaseBank>& ownBank, bool& final)
+{
+    if (realtime) {
+        bool bankFinal;
+        const PolyphaseBank *bank = banks.GetBank(band, bankFinal);
+        final = final && bankFinal;
+        return bank;
+    }
+
+    const PolyphaseBank *bank = banks.WaitForBank(band);
+    if (bank)
+        return bank;
+    ownBank = banks.Compute(band);
+    return ownBank.get();
+}
+
+void PolyphaseResampler::Reset()
+{
+    resetBuffer(SINC_WINDOW_SIZE);
+    phase = 0.0f;
+}
+
+SincResampler::SincResampler()
+    : PolyphaseResampler(ResamplerType::SINC)
+{
+}
+
+SincResampler::~SincResampler()
+{
+}
+
+bool SincResampler::Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata)
+{
+    CallbackFetchSource src{cbPtr, cbdata};
+    return ProcessT(outData, numBlocks, phaseInc, src);
 }
 
 /*
@@ -293,63 +618,24 @@ float SincResampler::window_func(float t)
     return win_lut[left_index] + fraction * (win_lut[right_index] - win_lut[left_index]);
 }
 
-BlepResampler::BlepResampler()
+float SincResampler::kernel(float t, float sincStep)
 {
-    Reset();
+    return fast_sincf(t * sincStep) * window_func(t);
 }
 
-BlepResampler::~BlepResampler()
+BlepResampler::BlepResampler()
+    : PolyphaseResampler(ResamplerType::BLEP)
 {
 }
 
-void BlepResampler::Reset()
+BlepResampler::~BlepResampler()
 {
-    fetchBuffer.clear();
-    fetchBuffer.resize(SINC_WINDOW_SIZE, 0.0f);
-    phase = 0.0f;
 }
 
 bool BlepResampler::Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata)
 {
-    if (numBlocks == 0)
-        return true;
-
-    size_t samplesRequired = static_cast<size_t>(
-            phase + phaseInc * static_cast<float>(numBlocks));
-    // be sure and fetch one more sample in case of odd rounding errors
-    samplesRequired += 1;
-    // fetch a few more for complete windowed sinc interpolation
-    samplesRequired += SINC_WINDOW_SIZE * 2;
-    bool result = cbPtr(fetchBuffer, samplesRequired, cbdata);
-
-    float sincStep = SINC_FILT_THRESH / phaseInc;
-
-    int i = 0;
-    do {
-        float sampleSum = 0.0f;
-        float kernelSum = 0.0f;
-        for (int wi = -SINC_WINDOW_SIZE + 1; wi <= SINC_WINDOW_SIZE; wi++) {
-            float SiIndexLeft = (float(wi) - phase - 0.5f) * sincStep;
-            float SiIndexRight = (float(wi) - phase + 0.5f) * sincStep;
-            float sl = fast_Si(SiIndexLeft);
-            float sr = fast_Si(SiIndexRight);
-            float kernel = sr - sl;
-            sampleSum += kernel * fetchBuffer[i + wi + SINC_WINDOW_SIZE - 1];
-            kernelSum += kernel;
-        }
-        phase += phaseInc;
-        int istep = static_cast<int>(phase);
-        phase -= static_cast<float>(istep);
-        i += istep;
-
-        *outData++ = sampleSum / kernelSum;
-        //*outData++ = sampleSum;
-        //_print_debug("kernel sum: %f\n", kernelSum);
-    } while (--numBlocks > 0);
-    // remove first i elements from the fetch buffer since they are no longer needed
-    fetchBuffer.erase(fetchBuffer.begin(), fetchBuffer.begin() + i);
-
-    return result;
+    CallbackFetchSource src{cbPtr, cbdata};
+    return ProcessT(outData, numBlocks, phaseInc, src);
 }
 
 #define INTEGRAL_RESOLUTION 256
@@ -391,62 +677,24 @@ float BlepResampler::fast_Si(float t)
     return copysignf(retval, signed_t);
 }
 
-BlampResampler::BlampResampler()
+float BlepResampler::kernel(float t, float sincStep)
 {
-    Reset();
+    return fast_Si((t + 0.5f) * sincStep) - fast_Si((t - 0.5f) * sincStep);
 }
 
-BlampResampler::~BlampResampler()
+BlampResampler::BlampResampler()
+    : PolyphaseResampler(ResamplerType::BLAMP)
 {
 }
 
-void BlampResampler::Reset()
+BlampResampler::~BlampResampler()
 {
-    fetchBuffer.clear();
-    fetchBuffer.resize(SINC_WINDOW_SIZE, 0.0f);
-    phase = 0.0f;
 }
 
 bool BlampResampler::Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata)
 {
-    if (numBlocks == 0)
-        return true;
-
-    size_t samplesRequired = static_cast<size_t>(
-            phase + phaseInc * static_cast<float>(numBlocks));
-    // be sure and fetch one more sample in case of odd rounding errors
-    samplesRequired += 1;
-    // fetch a few more for complete windowed sinc interpolation
-    samplesRequired += SINC_WINDOW_SIZE * 2;
-    bool result = cbPtr(fetchBuffer, samplesRequired, cbdata);
-
-    float sincStep = SINC_FILT_THRESH / phaseInc;
-    int i = 0;
-    do {
-        float sampleSum = 0.0f;
-        float kernelSum = 0.0f;
-        for (int wi = -SINC_WINDOW_SIZE + 1; wi <= SINC_WINDOW_SIZE; wi++) {
-            float TiIndexLeft = (float(wi) - phase - 1.0f) * sincStep;
-            float TiIndexMiddle = (float(wi) - phase) * sincStep;
-            float TiIndexRight = (float(wi) - phase + 1.0f) * sincStep;
-            float sl = fast_Ti(TiIndexLeft);
-            float sm = fast_Ti(TiIndexMiddle);
-            float sr = fast_Ti(TiIndexRight);
-            float kernel = sr - 2.0f * sm + sl;
-            sampleSum += kernel * fetchBuffer[i + wi + SINC_WINDOW_SIZE - 1];
-            kernelSum += kernel;
-        }
-        phase += phaseInc;
-        int istep = static_cast<int>(phase);
-        phase -= static_cast<float>(istep);
-        i += istep;
-
-        *outData++ = sampleSum / kernelSum;
-    } while (--numBlocks > 0);
-    // remove first i elements from the fetch buffer since they are no longer needed
-    fetchBuffer.erase(fetchBuffer.begin(), fetchBuffer.begin() + i);
-
-    return result;
+    CallbackFetchSource src{cbPtr, cbdata};
+    return ProcessT(outData, numBlocks, phaseInc, src);
 }
 
 // I call "Ti" the integral of Si function. I don't know its proper name
@@ -493,3 +741,74 @@ float BlampResampler::fast_Ti(float t)
     else
         return retval;
 }
+
+float BlampResampler::kernel(float t, float sincStep)
+{
+    return fast_Ti((t + 1.0f) * sincStep) - 2.0f * fast_Ti(t * sincStep) + fast_Ti((t - 1.0f) * sincStep);
+}
+
+/*
+ * polyphase bank sets, defined after the LUTs the kernels use
+ */
+
+static PolyphaseBankSet sincBanks(SincResampler::kernel, 0);
+static PolyphaseBankSet blepBanks(BlepResampler::kernel, -POLYPHASE_BAND_LIMIT);
+static PolyphaseBankSet blampBanks(BlampResampler::kernel, -POLYPHASE_BAND_LIMIT);
+
+PolyphaseBankSet& PolyphaseBankSet::Get(ResamplerType type)
+{
+    switch (type) {
+    case ResamplerType::BLEP:
+        return blepBanks;
+    case ResamplerType::BLAMP:
+        return blampBanks;
+    default:
+        return sincBanks;
+    }
+}
+
+/*
+ * ResamplerPool
+ */
+
+ResamplerPool::Ptr ResamplerPool::Get(ResamplerType type)
+{
+    auto& freeList = freeResamplers[static_cast<size_t>(type)];
+    if (!freeList.empty()) {
+        Resampler *rs = freeList.back().release();
+        freeList.pop_back();
+        rs->Reset();
+        rs->SetRealtime(realtime);
+        return Ptr(rs, Recycler{this, type});
+    }
+
+    std::unique_ptr<Resampler> rs;
+    switch (type) {
+    case ResamplerType::NEAREST:
+        rs = std::make_unique<NearestResampler>();
+        break;
+    case ResamplerType::LINEAR:
+        rs = std::make_unique<LinearResampler>();
+        break;
+    case ResamplerType::SINC:
+        rs = std::make_unique<SincResampler>();
+        break;
+    case ResamplerType::BLEP:
+        rs = std::make_unique<BlepResampler>();
+        break;
+    case ResamplerType::BLAMP:
+        rs = std::make_unique<BlampResampler>();
+        break;
+    }
+    rs->SetRealtime(realtime);
+    return Ptr(rs.release(), Recycler{this, type});
+}
+
+void ResamplerPool::Recycler::operator()(Resampler *rs) const
+{
+    if (pool == nullptr) {
+        delete rs;
+        return;
+    }
+    pool->freeResamplers[static_cast<size_t>(type)].emplace_back(rs);
+}
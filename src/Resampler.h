@@ -1,14 +1,44 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+#include "Types.h"
 
 /* 
- * res_data_fetch_cb fetches samplesRequired samples to fetchBuffer
- * so that the buffer can provide exactly samplesRequired samples
+ * res_data_fetch_cb appends exactly samplesToFetch (> 0) samples to the span
+ * starting at fetchBuffer. Samples past the end of stream must be zero.
  *
  * returns false in case of 'end of stream'
  */
-typedef bool (*res_data_fetch_cb)(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata);
+typedef bool (*res_data_fetch_cb)(float *fetchBuffer, size_t samplesToFetch, void *cbdata);
+
+#define SINC_WINDOW_SIZE 16
+#define SINC_FILT_THRESH 0.85f
+
+/*
+ * Besides the virtual Process, every resampler has a ProcessT template which
+ * takes the sample source as functor with the signature of res_data_fetch_cb
+ * (minus cbdata). Voices pick a ProcessT instance for their resampler and
+ * source type once, so that the fetch can be inlined into the resampling loop.
+ */
+
+// adapter for passing a plain callback as source
+struct CallbackFetchSource {
+    res_data_fetch_cb cbPtr;
+    void *cbdata;
+    bool operator()(float *fetchBuffer, size_t samplesToFetch) const { return cbPtr(fetchBuffer, samplesToFetch, cbdata); }
+};
+
+// adapter for a callback which is known at compile time
+template<res_data_fetch_cb cbPtr>
+struct StaticFetchSource {
+    void *cbdata;
+    bool operator()(float *fetchBuffer, size_t samplesToFetch) const { return cbPtr(fetchBuffer, samplesToFetch, cbdata); }
+};
 
 class Resampler {
 public:
@@ -16,42 +46,274 @@ public:
     virtual bool Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata) = 0;
     virtual void Reset() = 0;
     virtual ~Resampler();
-    static bool ResamplerChainSampleFetchCB(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata);
-    struct ResamplerChainData {
-        // pointer to access our object
-        Resampler *_this;
-        // parameters for process method
-        float phaseInc;
-        res_data_fetch_cb cbPtr;
-        void *cbdata;
-    };
+    // a realtime resampler never waits, e.g. for a polyphase bank to be computed
+    void SetRealtime(bool realtime) { this->realtime = realtime; }
 protected:
+    /*
+     * fetchBuffer holds the unconsumed input history between readPos and
+     * writePos. It only gets compacted once the write cursor would run past
+     * its capacity, so the per block cost is just moving the read cursor.
+     */
+    template<typename Source>
+    bool fetch(size_t samplesRequired, Source& src)
+    {
+        size_t samplesAvailable = writePos - readPos;
+        if (samplesAvailable >= samplesRequired)
+            return true;
+        if (readPos + samplesRequired > fetchBuffer.size())
+            makeRoom(samplesRequired);
+
+        size_t samplesToFetch = samplesRequired - samplesAvailable;
+        float *dest = &fetchBuffer[writePos];
+        writePos += samplesToFetch;
+        return src(dest, samplesToFetch);
+    }
+    void makeRoom(size_t samplesRequired);
+    void resetBuffer(size_t history);
+    const float *window() const { return &fetchBuffer[readPos]; }
+    void consume(size_t numSamples) { readPos += numSamples; }
+
     std::vector<float> fetchBuffer;
+    size_t readPos = 0;
+    size_t writePos = 0;
     float phase;
+    bool realtime = false;
+};
+
+/*
+ * PolyphaseBank holds the normalized kernels of a windowed sinc style filter
+ * for a fixed set of fractional phases. The kernels are computed once per
+ * kernel function and cutoff band and are shared between all resamplers, so
+ * that every output sample only costs a few dot products instead of a full
+ * kernel evaluation.
+ */
+class PolyphaseBank {
+public:
+    typedef float (*kernel_func)(float t, float sincStep);
+
+    PolyphaseBank(kernel_func kernel, float sincStep);
+    PolyphaseBank(const PolyphaseBank&) = delete;
+    PolyphaseBank& operator=(const PolyphaseBank&) = delete;
+
+    float Convolve(const float *data, float phase) const;
+    // evaluates the kernel function for every tap, the reference for the tables
+    float ConvolveDirect(const float *data, float phase) const;
+    size_t GetSize() const;
+
+    typedef float (*convolve_func)(const float *ka, const float *data, float fraction);
+    struct ConvolveImpl {
+        const char *name;
+        convolve_func func;
+    };
+    // implementations this CPU supports, the scalar one first
+    static std::vector<ConvolveImpl> GetConvolveImpls();
+private:
+    kernel_func kernel;
+    float sincStep;
+    size_t phases;
+    std::vector<float> kernels;
+};
+
+/*
+ * PolyphaseBankSet holds the banks of one kernel function for all cutoff
+ * bands. For realtime playback, banks are computed by a background thread
+ * once a band is first requested; until then GetBank returns the bank of the
+ * closest band which is available, so the audio thread never waits for a bank
+ * or allocates one. Offline rendering has to be deterministic and uses
+ * WaitForBank instead, which computes a missing bank right away.
+ * The total size of the banks is limited, past the limit no more banks are
+ * computed: realtime playback uses the closest band from then on and offline
+ * rendering computes a bank of its own.
+ */
+class PolyphaseBankSet {
+public:
+    static PolyphaseBankSet& Get(ResamplerType type);
+    // the cutoff lies between band and band + 1, fraction is the position in between
+    static void GetBand(float sincStep, int& band, float& fraction);
+
+    PolyphaseBankSet(PolyphaseBank::kernel_func kernel, int minBand);
+    ~PolyphaseBankSet();
+    PolyphaseBankSet(const PolyphaseBankSet&) = delete;
+    PolyphaseBankSet& operator=(const PolyphaseBankSet&) = delete;
+
+    // never blocks, final is false if a better bank will be available later
+    const PolyphaseBank *GetBank(int band, bool& final);
+    // nullptr if the size limit doesn't allow another bank
+    const PolyphaseBank *WaitForBank(int band);
+    std::unique_ptr<PolyphaseBank> Compute(int band) const;
+private:
+    friend class PolyphaseBankBuilder;
+    enum : uint8_t { BANK_MISSING, BANK_REQUESTED, BANK_DONE, BANK_DENIED };
+
+    size_t index(int band) const;
+    // called with the builder mutex held
+    const PolyphaseBank *computeBank(size_t i, size_t& bankBytes);
+    void computeRequested(size_t& bankBytes);
+
+    PolyphaseBank::kernel_func kernel;
+    int minBand;
+    std::vector<std::atomic<const PolyphaseBank *>> banks;
+    std::vector<std::atomic<uint8_t>> states;
+    std::vector<std::unique_ptr<const PolyphaseBank>> ownedBanks;
 };
 
-class NearestResampler : public Resampler {
+class NearestResampler final : public Resampler {
 public:
     NearestResampler();
     ~NearestResampler() override;
     bool Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata) override;
     void Reset() override;
+
+    template<typename Source>
+    bool ProcessT(float *outData, size_t numBlocks, float phaseInc, Source& src)
+    {
+        if (numBlocks == 0)
+            return true;
+
+        size_t samplesRequired = size_t(phase + phaseInc * static_cast<float>(numBlocks));
+        // be sure and fetch one more sample in case of odd rounding errors
+        samplesRequired += 1;
+        bool result = fetch(samplesRequired, src);
+        const float *buf = window();
+
+        int i = 0;
+        do {
+            float sample = buf[i];
+            phase += phaseInc;
+            int istep = static_cast<int>(phase);
+            phase -= static_cast<float>(istep);
+            i += istep;
+
+            *outData++ = sample;
+        } while (--numBlocks > 0);
+
+        // first i elements of the fetch buffer are no longer needed
+        consume(static_cast<size_t>(i));
+
+        return result;
+    }
 };
 
-class LinearResampler : public Resampler {
+class LinearResampler final : public Resampler {
 public:
     LinearResampler();
     ~LinearResampler() override;
     bool Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata) override;
     void Reset() override;
+
+    template<typename Source>
+    bool ProcessT(float *outData, size_t numBlocks, float phaseInc, Source& src)
+    {
+        if (numBlocks == 0)
+            return true;
+
+        size_t samplesRequired = static_cast<size_t>(
+                phase + phaseInc * static_cast<float>(numBlocks));
+        // be sure and fetch one more sample in case of odd rounding errors
+        samplesRequired += 1;
+        // fetch one more for linear interpolation
+        samplesRequired += 1;
+        bool result = fetch(samplesRequired, src);
+        const float *buf = window();
+
+        int i = 0;
+        do {
+            float a = buf[i];
+            float b = buf[i+1];
+            float sample = a + phase * (b - a);
+            phase += phaseInc;
+            int istep = static_cast<int>(phase);
+            phase -= static_cast<float>(istep);
+            i += istep;
+
+            *outData++ = sample;
+        } while (--numBlocks > 0);
+
+        // first i elements of the fetch buffer are no longer needed
+        consume(static_cast<size_t>(i));
+
+        return result;
+    }
+};
+
+/*
+ * common processing of the sinc style resamplers, which only differ in
+ * their kernel function and cutoff
+ */
+class PolyphaseResampler : public Resampler {
+public:
+    void Reset() override;
+protected:
+    PolyphaseResampler(ResamplerType type);
+
+    template<typename Source>
+    bool processPolyphase(float *outData, size_t numBlocks, float phaseInc, float sincStep, Source& src)
+    {
+        if (numBlocks == 0)
+            return true;
+
+        size_t samplesRequired = static_cast<size_t>(
+                phase + phaseInc * static_cast<float>(numBlocks));
+        // be sure and fetch one more sample in case of odd rounding errors
+        samplesRequired += 1;
+        // fetch a few more for complete windowed sinc interpolation
+        samplesRequired += SINC_WINDOW_SIZE * 2;
+        bool result = fetch(samplesRequired, src);
+        const float *buf = window();
+
+        int band;
+        float bandFraction;
+        PolyphaseBankSet::GetBand(sincStep, band, bandFraction);
+        if (band != bankBand)
+            selectBanks(band);
+
+        int i = 0;
+        do {
+            // the kernel of a cutoff between two bands is interpolated
+            float sample = bankLo->Convolve(&buf[i], phase);
+            if (bandFraction != 0.0f)
+                sample += bandFraction * (bankHi->Convolve(&buf[i], phase) - sample);
+            phase += phaseInc;
+            int istep = static_cast<int>(phase);
+            phase -= static_cast<float>(istep);
+            i += istep;
+
+            *outData++ = sample;
+        } while (--numBlocks > 0);
+
+        // first i elements of the fetch buffer are no longer needed
+        consume(static_cast<size_t>(i));
+
+        return result;
+    }
+
+    void selectBanks(int band);
+    const PolyphaseBank *selectBank(int band, std::unique_ptr<const PolyphaseBank>& ownBank, bool& final);
+
+    PolyphaseBankSet& banks;
+    const PolyphaseBank *bankLo;
+    const PolyphaseBank *bankHi;
+    int bankBand;
+    // offline rendering only, if the size limit of the bank set is reached
+    std::unique_ptr<const PolyphaseBank> ownBankLo;
+    std::unique_ptr<const PolyphaseBank> ownBankHi;
 };
 
-class SincResampler : public Resampler {
+class SincResampler final : public PolyphaseResampler {
 public:
     SincResampler();
     ~SincResampler() override;
     bool Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata) override;
-    void Reset() override;
+
+    template<typename Source>
+    bool ProcessT(float *outData, size_t numBlocks, float phaseInc, Source& src)
+    {
+        float sincStep = phaseInc > SINC_FILT_THRESH ? SINC_FILT_THRESH / phaseInc : 1.00f;
+        return processPolyphase(outData, numBlocks, phaseInc, sincStep, src);
+    }
+
+    // kernel function of the polyphase banks
+    static float kernel(float t, float sincStep);
 private:
     static float fast_sinf(float t);
     static float fast_cosf(float t);
@@ -59,22 +321,77 @@ private:
     static float window_func(float t);
 };
 
-class BlepResampler : public Resampler {
+class BlepResampler final : public PolyphaseResampler {
 public:
     BlepResampler();
     ~BlepResampler() override;
     bool Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata) override;
-    void Reset() override;
+
+    template<typename Source>
+    bool ProcessT(float *outData, size_t numBlocks, float phaseInc, Source& src)
+    {
+        return processPolyphase(outData, numBlocks, phaseInc, SINC_FILT_THRESH / phaseInc, src);
+    }
+
+    // kernel function of the polyphase banks
+    static float kernel(float t, float sincStep);
 private:
     static float fast_Si(float t);
 };
 
-class BlampResampler : public Resampler {
+class BlampResampler final : public PolyphaseResampler {
 public:
     BlampResampler();
     ~BlampResampler() override;
     bool Process(float *outData, size_t numBlocks, float phaseInc, res_data_fetch_cb cbPtr, void *cbdata) override;
-    void Reset() override;
+
+    template<typename Source>
+    bool ProcessT(float *outData, size_t numBlocks, float phaseInc, Source& src)
+    {
+        return processPolyphase(outData, numBlocks, phaseInc, SINC_FILT_THRESH / phaseInc, src);
+    }
+
+    // kernel function of the polyphase banks
+    static float kernel(float t, float sincStep);
 private:
     static float fast_Ti(float t);
 };
+
+/*
+ * source which feeds the output of another resampler into a resampler,
+ * i.e. for resampling in two stages
+ */
+template<typename R, typename Source>
+struct ResamplerChainSource {
+    R& rs;
+    float phaseInc;
+    Source& src;
+    bool operator()(float *fetchBuffer, size_t samplesToFetch) { return rs.ProcessT(fetchBuffer, samplesToFetch, phaseInc, src); }
+};
+
+/*
+ * ResamplerPool hands out resamplers and takes them back once a voice is
+ * destroyed, so that starting a note doesn't have to allocate a resampler
+ * and its fetch buffer. A pool must outlive all resamplers it handed out.
+ */
+class ResamplerPool {
+public:
+    ResamplerPool() = default;
+    ResamplerPool(const ResamplerPool&) = delete;
+    ResamplerPool& operator=(const ResamplerPool&) = delete;
+
+    struct Recycler {
+        ResamplerPool *pool = nullptr;
+        ResamplerType type = ResamplerType::NEAREST;
+        void operator()(Resampler *rs) const;
+    };
+    typedef std::unique_ptr<Resampler, Recycler> Ptr;
+
+    Ptr Get(ResamplerType type);
+    // applies to all resamplers handed out from now on
+    void SetRealtime(bool realtime) { this->realtime = realtime; }
+private:
+    static const size_t NUM_TYPES = static_cast<size_t>(ResamplerType::BLAMP) + 1;
+    std::vector<std::unique_ptr<Resampler>> freeResamplers[NUM_TYPES];
+    bool realtime = false;
+};
@@ -1,94 +1,83 @@
 #include <algorithm>
 
 #include "Ringbuffer.h"
+#include "OS.h"
+#include "Xcept.h"
 
 /*
  * public Ringbuffer
  */
 
 Ringbuffer::Ringbuffer(size_t elementCount)
-    : bufData(elementCount), freeCount(elementCount)
+    : bufData(elementCount)
 {
 }
 
 void Ringbuffer::Put(sample *inData, size_t nElements)
 {
-    std::unique_lock<std::mutex> lock(countLock);
-    while (freeCount < nElements){
-        sig.wait(lock);
-    }
-    while (nElements > 0) {
-        size_t count = putChunk(inData, nElements);
-        inData += count;
-        nElements -= count;
+    // waiting for more space than the buffer has would never return
+    if (nElements > bufData.size())
+        throw Xcept("Ringbuffer: cannot put %zu samples into a buffer of %zu", nElements, bufData.size());
+
+    const size_t curHead = head.load(std::memory_order_relaxed);
+    while (freeCount(curHead) < nElements) {
+        const uint32_t seq = takeSeq.load(std::memory_order_acquire);
+        producerWaiting.store(true);
+        // the consumer may have taken data before it could see the flag
+        if (freeCount(curHead) < nElements)
+            OS::FutexWait(takeSeq, seq);
+        producerWaiting.store(false, std::memory_order_relaxed);
     }
+
+    const size_t pos = curHead % bufData.size();
+    const size_t count = std::min(nElements, bufData.size() - pos);
+    std::copy(inData, inData + count, &bufData[pos]);
+    std::copy(inData + count, inData + nElements, &bufData[0]);
+    head.store(curHead + nElements, std::memory_order_release);
 }
 
-void Ringbuffer::Take(sample *outData, size_t nElements)
+void Ringbuffer::Clear()
 {
-    if (dataCount < nElements) {
-        // underrun
+    // the consumer owns tail, so let it skip everything that has been put so far
+    discardUntil.store(head.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+bool Ringbuffer::Take(sample *outData, size_t nElements)
+{
+    size_t curTail = tail.load(std::memory_order_relaxed);
+    curTail = std::max(curTail, discardUntil.load(std::memory_order_acquire));
+    const size_t curHead = head.load(std::memory_order_acquire);
+
+    const bool underrun = curHead - curTail < nElements;
+    if (underrun) {
         std::fill(outData, outData + nElements, sample{0.0f, 0.0f});
     } else {
         // output
-        std::unique_lock<std::mutex> lock(countLock);
-        while (nElements > 0) {
-            size_t count = takeChunk(outData, nElements);
-            outData += count;
-            nElements -= count;
-        }
-        sig.notify_one();
+        const size_t pos = curTail % bufData.size();
+        const size_t count = std::min(nElements, bufData.size() - pos);
+        std::copy(&bufData[pos], &bufData[pos] + count, outData);
+        std::copy(&bufData[0], &bufData[0] + (nElements - count), outData + count);
+        curTail += nElements;
     }
+
+    tail.store(curTail);
+    takeSeq.fetch_add(1, std::memory_order_release);
+    if (producerWaiting.load())
+        OS::FutexWake(takeSeq);
+    return !underrun;
 }
 
-void Ringbuffer::Clear()
+size_t Ringbuffer::GetFillLevel() const
 {
-    std::unique_lock<std::mutex> lock(countLock);
-    std::fill(bufData.begin(), bufData.end(), sample{0.0f, 0.0f});
-    freePos = 0;
-    dataPos = 0;
-    freeCount = bufData.size();
-    dataCount = 0;
+    const size_t curTail = std::max(tail.load(std::memory_order_relaxed), discardUntil.load(std::memory_order_relaxed));
+    return head.load(std::memory_order_acquire) - curTail;
 }
 
 /*
  * private Ringbuffer
  */
 
-size_t Ringbuffer::putChunk(sample *inData, size_t nElements)
-{
-    bool wrap = nElements >= bufData.size() - freePos;
-    size_t count;
-    size_t newfree;
-    if (wrap) {
-        count = size_t(bufData.size() - freePos);
-        newfree = 0;
-    } else {
-        count = nElements;
-        newfree = freePos + count;
-    }
-    std::copy(inData, inData + count, &bufData[freePos]);
-    freePos = newfree;
-    freeCount -= count;
-    dataCount += count;
-    return count;
-}
-
-size_t Ringbuffer::takeChunk(sample *outData, size_t nElements)
+size_t Ringbuffer::freeCount(size_t curHead) const
 {
-    bool wrap = nElements >= bufData.size() - dataPos;
-    size_t count;
-    size_t newdata;
-    if (wrap) {
-        count = size_t(bufData.size() - dataPos);
-        newdata = 0;
-    } else {
-        count = nElements;
-        newdata = dataPos + count;
-    }
-    std::copy(&bufData[dataPos], &bufData[dataPos] + count, outData);
-    dataPos = newdata;
-    freeCount += count;
-    dataCount -= count;
-    return count;
+    return bufData.size() - (curHead - tail.load());
 }
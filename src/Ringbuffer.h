@@ -1,12 +1,20 @@
 #pragma once
 
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 
 #include "Types.h"
 
+/*
+ * Single producer/single consumer ring buffer. Take() is called from the
+ * audio callback and is wait-free. Put() blocks until enough space is
+ * available, the consumer wakes it after each Take().
+ *
+ * head and tail are monotonic element counters, the position in the buffer is
+ * the counter modulo its size.
+ */
 class Ringbuffer
 {
 public:
@@ -14,18 +22,23 @@ public:
     Ringbuffer(const Ringbuffer&) = delete;
     Ringbuffer& operator=(const Ringbuffer&) = delete;
 
+    // producer side
     void Put(sample *inData, size_t nElements);
-    void Take(sample *outData, size_t nElements);
     void Clear();
+    // consumer side, returns false on underrun
+    bool Take(sample *outData, size_t nElements);
+    size_t GetFillLevel() const;
+    size_t GetSize() const { return bufData.size(); }
 private:
-    size_t putChunk(sample *inData, size_t nElements);
-    size_t takeChunk(sample *outData, size_t nElements);
+    size_t freeCount(size_t curHead) const;
 
     std::vector<sample> bufData;
-    std::mutex countLock;
-    std::condition_variable sig;
-    size_t freePos = 0;
-    size_t dataPos = 0;
-    size_t freeCount;
-    size_t dataCount = 0;
+
+    // written by the producer
+    alignas(64) std::atomic<size_t> head{0};
+    std::atomic<size_t> discardUntil{0};
+    std::atomic<bool> producerWaiting{false};
+    // written by the consumer
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<uint32_t> takeSeq{0};
 };
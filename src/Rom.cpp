@@ -7,6 +7,7 @@
 #include "Xcept.h"
 #include "Debug.h"
 #include "Util.h"
+#include "OS.h"
 
 std::unique_ptr<Rom> Rom::global_instance;
 
@@ -17,7 +18,20 @@ std::unique_ptr<Rom> Rom::global_instance;
 Rom::Rom(const std::filesystem::path& filePath)
 {
     loadFile(filePath);
-    verify();
+    // the destructor doesn't run if the constructor throws
+    try {
+        verify();
+    } catch (...) {
+        if (mapped)
+            OS::UnmapFile(data, size);
+        throw;
+    }
+}
+
+Rom::~Rom()
+{
+    if (mapped)
+        OS::UnmapFile(data, size);
 }
 
 void Rom::CreateInstance(const std::filesystem::path& filePath)
@@ -29,7 +43,7 @@ std::string Rom::ReadString(size_t pos, size_t limit) const
 {
     std::string result;
     for (size_t i = 0; i < limit; i++) {
-        char c = static_cast<char>(data.at(pos + i));
+        char c = static_cast<char>(at(pos + i));
         if (c == '\0')
             break;
         result += c;
@@ -42,6 +56,14 @@ std::string Rom::GetROMCode() const
     return ReadString(0xAC, 4);
 }
 
+uint64_t Rom::GetHash() const
+{
+    std::call_once(hashOnce, [this]() {
+        hash = Fnv1a64(data, size);
+    });
+    return hash;
+}
+
 /*
  * private
  */
@@ -49,7 +71,7 @@ std::string Rom::GetROMCode() const
 void Rom::verify() 
 {
     // check ROM size
-    if (data.size() > AGB_ROM_SIZE || data.size() < 0x200)
+    if (size > AGB_ROM_SIZE || size < 0x200)
         throw Xcept("Illegal ROM size");
     
     // Logo data
@@ -69,15 +91,15 @@ void Rom::verify()
 
     // check logo
     for (size_t i = 0; i < sizeof(imageBytes); i++) {
-        if (imageBytes[i] != data.at(i + 0x4))
+        if (imageBytes[i] != at(i + 0x4))
             throw Xcept("ROM verification: Bad Nintendo Logo");
     }
 
     // check checksum
-    uint8_t checksum = data.at(0xBD);
+    uint8_t checksum = at(0xBD);
     int check = 0;
     for (size_t i = 0xA0; i < 0xBD; i++) {
-        check -= data.at(i);
+        check -= at(i);
     }
     check = (check - 0x19) & 0xFF;
     if (check != checksum)
@@ -86,27 +108,44 @@ void Rom::verify()
 
 void Rom::loadFile(const std::filesystem::path& filePath)
 {
+    /* Mapping the file avoids copying it and lets processes which use the
+     * same ROM share the page cache. */
+    size_t mappedSize;
+    const void *mapping = OS::MapFile(filePath, mappedSize);
+    if (mapping != nullptr) {
+        if (mappedSize > AGB_ROM_SIZE) {
+            OS::UnmapFile(mapping, mappedSize);
+            throw Xcept("Input ROM exceeds 32 MiB file limit");
+        }
+        data = static_cast<const uint8_t *>(mapping);
+        size = mappedSize;
+        mapped = true;
+        return;
+    }
+
     std::ifstream is(filePath, std::ios_base::binary);
     if (!is.is_open()) {
         throw Xcept("Error while opening ROM: %s", strerror(errno));
     }
     is.seekg(0, std::ios_base::end);
-    std::ifstream::pos_type size = is.tellg();
-    if (size == -1) {
+    std::ifstream::pos_type fileSize = is.tellg();
+    if (fileSize == -1) {
         throw Xcept("Error while seeking in input file");
     }
-    if (size > AGB_ROM_SIZE) {
+    if (fileSize > AGB_ROM_SIZE) {
         throw Xcept("Input ROM exceeds 32 MiB file limit");
     }
     is.seekg(0, std::ios_base::beg);
-    data.resize(static_cast<size_t>(size));
+    fileData.resize(static_cast<size_t>(fileSize));
 
     // copy file to memory
-    is.read(reinterpret_cast<char *>(data.data()), size);
+    is.read(reinterpret_cast<char *>(fileData.data()), fileSize);
     if (is.bad())
         throw Xcept("read bad");
     if (is.fail()) {
         throw Xcept("read fail");
     }
     is.close();
+    data = fileData.data();
+    size = fileData.size();
 }
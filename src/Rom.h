@@ -5,13 +5,62 @@
 #include <vector>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 
 #include "AgbTypes.h"
 #include "Xcept.h"
+#include "Util.h"
+
+/*
+ * Part of the ROM with a known size, e.g. an instrument record. The bounds are
+ * checked once by Rom::View, reads are unchecked afterwards. Build with
+ * -DAGBPLAY_CHECKED_ROM to check every read as well (e.g. for fuzzing).
+ */
+class RomView
+{
+public:
+    RomView(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+    uint8_t ReadU8(size_t pos) const {
+        check(pos, 1);
+        return data[pos];
+    }
+
+    int8_t ReadS8(size_t pos) const {
+        return static_cast<int8_t>(ReadU8(pos));
+    }
+
+    uint16_t ReadU16(size_t pos) const {
+        check(pos, 2);
+        return LoadLE16(data + pos);
+    }
+
+    uint32_t ReadU32(size_t pos) const {
+        check(pos, 4);
+        return LoadLE32(data + pos);
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+private:
+    void check([[maybe_unused]] size_t pos, [[maybe_unused]] size_t len) const {
+#ifdef AGBPLAY_CHECKED_ROM
+        if (pos > size || len > size - pos)
+            throw std::out_of_range("ROM view read out of range");
+#endif
+    }
+
+    const uint8_t *data;
+    size_t size;
+};
 
 class Rom {
 public:
     Rom(const std::filesystem::path& filePath);
+    ~Rom();
     Rom(const Rom&) = delete;
     Rom& operator=(const Rom&) = delete;
     static void CreateInstance(const std::filesystem::path& filePath);
@@ -20,15 +69,19 @@ public:
     }
 
     const uint8_t& operator[](size_t pos) const {
+#ifdef AGBPLAY_CHECKED_ROM
+        return at(pos);
+#else
         return data[pos];
+#endif
     }
 
     int8_t ReadS8(size_t pos) const {
-        return static_cast<int8_t>(data.at(pos));
+        return static_cast<int8_t>(at(pos));
     }
 
     uint8_t ReadU8(size_t pos) const {
-        return data.at(pos);
+        return at(pos);
     }
 
     int16_t ReadS16(size_t pos) const {
@@ -36,10 +89,8 @@ public:
     }
 
     uint16_t ReadU16(size_t pos) const {
-        uint32_t retval = data.at(pos + 1);
-        retval <<= 8;
-        retval |= data[pos];
-        return static_cast<uint16_t>(retval);
+        check(pos, 2);
+        return LoadLE16(data + pos);
     }
 
     int32_t ReadS32(size_t pos) const {
@@ -47,47 +98,71 @@ public:
     }
 
     uint32_t ReadU32(size_t pos) const {
-        uint32_t retval = data.at(pos + 3);
-        retval <<= 8;
-        retval |= data[pos + 2];
-        retval <<= 8;
-        retval |= data[pos + 1];
-        retval <<= 8;
-        retval |= data[pos + 0];
-        return retval;
+        check(pos, 4);
+        return LoadLE32(data + pos);
     }
 
     size_t ReadAgbPtrToPos(size_t pos) const {
-        uint32_t ptr = ReadU32(pos);
+        return AgbPtrToPos(ReadU32(pos), pos);
+    }
+
+    // pos is the location of the pointer, for the error message
+    size_t AgbPtrToPos(uint32_t ptr, size_t pos) const {
         if (!ValidPointer(ptr))
             throw Xcept("Cannot parse pointer at [%08zX]=%08X", pos, ptr);
         return ptr - AGB_MAP_ROM;
     }
 
     const void *GetPtr(size_t pos) const {
-        return &data[pos];
+        return &(*this)[pos];
+    }
+
+    // checks the bounds once for all reads through the view
+    RomView View(size_t pos, size_t len) const {
+        if (pos > size || len > size - pos)
+            throw Xcept("ROM read out of range: [%08zX] + %zu", pos, len);
+        return RomView(data + pos, len);
     }
 
     size_t Size() const {
-        return data.size();
+        return size;
     }
 
     bool ValidPointer(uint32_t ptr) const {
-        if (ptr - AGB_MAP_ROM >= data.size())
+        if (ptr - AGB_MAP_ROM >= size)
             return false;
-        if (ptr - AGB_MAP_ROM + 1 >= data.size())
+        if (ptr - AGB_MAP_ROM + 1 >= size)
             return false;
         return true;
     }
 
     std::string ReadString(size_t pos, size_t limit) const;
     std::string GetROMCode() const;
+    // hash of the whole ROM content, computed on first use
+    uint64_t GetHash() const;
 
 private:
+    void check(size_t pos, size_t len) const {
+        if (pos > size || len > size - pos)
+            throw std::out_of_range("ROM read out of range");
+    }
+
+    const uint8_t& at(size_t pos) const {
+        check(pos, 1);
+        return data[pos];
+    }
+
     void verify();
     void loadFile(const std::filesystem::path& filePath);
 
-    std::vector<uint8_t> data;
+    /* points either to the memory mapped file or to fileData if mapping
+     * isn't possible */
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<uint8_t> fileData;
+    mutable std::once_flag hashOnce;
+    mutable uint64_t hash = 0;
 
     static std::unique_ptr<Rom> global_instance;
 };
@@ -0,0 +1,224 @@
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <system_error>
+
+// sorry, for some reason multiple versions of jsoncpp use different paths :/
+#if __has_include(<json/json.h>)
+#include <json/json.h>
+#include <json/writer.h>
+#else
+#include <jsoncpp/json/json.h>
+#include <jsoncpp/json/writer.h>
+#endif
+
+#include "ScanCache.h"
+#include "ConfigManager.h"
+#include "PlayerContext.h"
+#include "Constants.h"
+#include "Debug.h"
+#include "Rom.h"
+#include "OS.h"
+
+// increase this whenever the scan or the length estimation changes
+#define SCAN_CACHE_VERSION 1
+
+/*
+ * public ScanCache
+ */
+
+ScanCache& ScanCache::Instance()
+{
+    static ScanCache cache;
+    return cache;
+}
+
+std::vector<SongTable> ScanCache::ScanForTables()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (!loaded) {
+        loaded = true;
+        if (!load()) {
+            Rom& rom = Rom::Instance();
+            for (SongTable& songTable : SongTable::ScanForTables()) {
+                std::vector<SongInfo>& songs = tables[songTable.GetSongTablePos()];
+                songs.resize(songTable.GetNumSongs());
+                for (uint16_t uid = 0; uid < songs.size(); uid++) {
+                    SongInfo& song = songs[uid];
+                    song.pos = songTable.GetPosOfSong(uid);
+                    if (song.pos + 8 <= rom.Size()) {
+                        song.numTracks = rom.ReadU8(song.pos);
+                        song.voicegroup = rom.ReadU32(song.pos + 4);
+                    }
+                }
+            }
+            dirty = true;
+        }
+    }
+
+    // same order as the scan, i.e. by position
+    std::vector<SongTable> result;
+    for (const auto& [pos, songs] : tables)
+        result.emplace_back(pos, songs.size());
+    return result;
+}
+
+size_t ScanCache::GetSongMicroframes(SongTable& songTable, uint16_t uid)
+{
+    const std::string key = lengthSettings();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        // lengths depend on the settings, drop them if these have changed
+        if (key != lengthKey) {
+            for (auto& [pos, songs] : tables) {
+                for (SongInfo& song : songs)
+                    song.microframes = -1;
+            }
+            lengthKey = key;
+        }
+        auto table = tables.find(songTable.GetSongTablePos());
+        if (table != tables.end() && uid < table->second.size() && table->second[uid].microframes >= 0)
+            return static_cast<size_t>(table->second[uid].microframes);
+    }
+
+    // estimate without holding the lock, so multiple threads can do this at once
+    const size_t microframes = estimateSong(songTable.GetPosOfSong(uid));
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto table = tables.find(songTable.GetSongTablePos());
+    if (table != tables.end() && uid < table->second.size() && key == lengthKey) {
+        table->second[uid].microframes = static_cast<int64_t>(microframes);
+        dirty = true;
+    }
+    return microframes;
+}
+
+void ScanCache::Save()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!dirty)
+        return;
+    dirty = false;
+
+    Json::Value root;
+    root["version"] = SCAN_CACHE_VERSION;
+    root["rom-size"] = static_cast<Json::UInt64>(Rom::Instance().Size());
+    root["length-settings"] = lengthKey;
+    Json::Value tablesJson(Json::arrayValue);
+    for (const auto& [pos, songs] : tables) {
+        Json::Value tableJson;
+        tableJson["pos"] = static_cast<Json::UInt64>(pos);
+        Json::Value songsJson(Json::arrayValue);
+        for (const SongInfo& song : songs) {
+            Json::Value songJson;
+            songJson["pos"] = static_cast<Json::UInt64>(song.pos);
+            songJson["tracks"] = song.numTracks;
+            songJson["voicegroup"] = song.voicegroup;
+            songJson["microframes"] = static_cast<Json::Int64>(song.microframes);
+            songsJson.append(songJson);
+        }
+        tableJson["songs"] = songsJson;
+        tablesJson.append(tableJson);
+    }
+    root["tables"] = tablesJson;
+
+    /* write to a temporary file first, so other instances never read a
+     * partially written cache */
+    const std::filesystem::path path = filePath();
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::ofstream file(tmpPath);
+    if (!file.is_open()) {
+        Debug::print("Scan cache: writing %s failed", tmpPath.string().c_str());
+        return;
+    }
+    Json::StreamWriterBuilder builder;
+    builder["commentStyle"] = "None";
+    builder["indentation"] = "";
+    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    writer->write(root, &file);
+    file.close();
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+        Debug::print("Scan cache: writing %s failed: %s", path.string().c_str(), ec.message().c_str());
+}
+
+/*
+ * private ScanCache
+ */
+
+bool ScanCache::load()
+{
+    std::ifstream file(filePath());
+    if (!file.is_open())
+        return false;
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors)) {
+        Debug::print("Scan cache: ignoring %s: %s", filePath().string().c_str(), errors.c_str());
+        return false;
+    }
+
+    // the file name is only a hash, make sure it is actually about this ROM
+    const Rom& rom = Rom::Instance();
+    if (root["version"].asInt() != SCAN_CACHE_VERSION || root["rom-size"].asUInt64() != rom.Size())
+        return false;
+
+    std::map<size_t, std::vector<SongInfo>> loadedTables;
+    for (const Json::Value& tableJson : root["tables"]) {
+        const size_t pos = static_cast<size_t>(tableJson["pos"].asUInt64());
+        if (pos >= rom.Size())
+            return false;
+        std::vector<SongInfo>& songs = loadedTables[pos];
+        for (const Json::Value& songJson : tableJson["songs"]) {
+            SongInfo song;
+            song.pos = static_cast<size_t>(songJson["pos"].asUInt64());
+            song.numTracks = static_cast<uint8_t>(songJson["tracks"].asUInt());
+            song.voicegroup = songJson["voicegroup"].asUInt();
+            song.microframes = songJson["microframes"].asInt64();
+            songs.push_back(song);
+        }
+    }
+    if (loadedTables.empty())
+        return false;
+
+    tables = std::move(loadedTables);
+    lengthKey = root["length-settings"].asString();
+    return true;
+}
+
+std::filesystem::path ScanCache::filePath() const
+{
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << Rom::Instance().GetHash() << ".json";
+    return OS::GetCacheDirectory() / "agbplay" / "scan" / name.str();
+}
+
+std::string ScanCache::lengthSettings()
+{
+    const ConfigManager& cm = ConfigManager::Instance();
+    std::ostringstream key;
+    key << "max-loops-export " << int(cm.GetMaxLoopsExport())
+        << " song-track-limit " << int(cm.GetCfg().GetTrackLimit());
+    return key.str();
+}
+
+size_t ScanCache::estimateSong(size_t songPos)
+{
+    const GameConfig& cfg = ConfigManager::Instance().GetCfg();
+
+    PlayerContext ctx(
+            ConfigManager::Instance().GetMaxLoopsExport(),
+            cfg.GetTrackLimit(),
+            EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq()),
+            ConfigManager::Instance().GetSampleRate()
+            );
+    ctx.InitSong(songPos);
+    // songs which loop endlessly are treated as one hour long
+    const size_t maxMicroframes = 60 * 60 * AGB_FPS * INTERFRAMES;
+    return ctx.EstimateMicroframes(maxMicroframes);
+}
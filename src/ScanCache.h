@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <filesystem>
+
+#include "SoundData.h"
+
+/*
+ * Results of scanning the current ROM, kept in a file named after the hash of
+ * the ROM content, so opening the same ROM again doesn't require a scan: the
+ * song tables, the header of each song and the estimated length of each song.
+ * Lengths are estimated on first use and are only valid for the settings
+ * they were estimated with (loops and track limit), they are estimated again
+ * if these change. All functions may be called from multiple threads.
+ */
+class ScanCache
+{
+public:
+    static ScanCache& Instance();
+
+    struct SongInfo
+    {
+        size_t pos = 0;
+        uint8_t numTracks = 0;
+        uint32_t voicegroup = 0;    // pointer as stored in the song header
+        int64_t microframes = -1;   // estimated length, -1 if unknown
+    };
+
+    // song tables of the current ROM, scans the ROM if they aren't cached
+    std::vector<SongTable> ScanForTables();
+    // estimated length with the current export settings, estimated if unknown
+    size_t GetSongMicroframes(SongTable& songTable, uint16_t uid);
+    // write the cache file if anything changed since the last save
+    void Save();
+private:
+    ScanCache() = default;
+    ScanCache(const ScanCache&) = delete;
+    ScanCache& operator=(const ScanCache&) = delete;
+
+    bool load();
+    std::filesystem::path filePath() const;
+    static std::string lengthSettings();
+    static size_t estimateSong(size_t songPos);
+
+    std::mutex mtx;
+    bool loaded = false;
+    bool dirty = false;
+    std::map<size_t, std::vector<SongInfo>> tables;  // song table position -> songs
+    std::string lengthKey;  // settings the lengths were estimated with
+};
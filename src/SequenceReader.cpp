@@ -1,5 +1,7 @@
 #include <cmath>
 #include <cassert>
+#include <cstdint>
+#include <algorithm>
 
 #include "SequenceReader.h"
 #include "Xcept.h"
@@ -8,6 +10,7 @@
 #include "Rom.h"
 #include "PlayerContext.h"
 #include "ConfigManager.h"
+#include "Profiler.h"
 
 #define NOTE_TIE -1
 #define NOTE_ALL 0xFE
@@ -54,6 +57,7 @@ SequenceReader::SequenceReader(PlayerContext& ctx, int8_t maxLoops)
 
 void SequenceReader::Process()
 {
+    PROFILE_SCOPE(ProfileStage::SEQUENCER);
     ctx.seq.bpmStack += uint32_t(float(ctx.seq.bpm) * speedFactor);
     while (ctx.seq.bpmStack >= BPM_PER_FRAME * INTERFRAMES) {
         processSequenceTick();
@@ -61,6 +65,18 @@ void SequenceReader::Process()
     }
 }
 
+/* returns how many following calls to Process are guaranteed not to step the sequence */
+size_t SequenceReader::GetMicroframesWithoutTick() const
+{
+    int32_t bpmInc = int32_t(uint32_t(float(ctx.seq.bpm) * speedFactor));
+    if (bpmInc <= 0)
+        return SIZE_MAX;
+    int32_t bpmLeft = BPM_PER_FRAME * INTERFRAMES - 1 - ctx.seq.bpmStack;
+    if (bpmLeft < 0)
+        return 0;
+    return static_cast<size_t>(bpmLeft / bpmInc);
+}
+
 bool SequenceReader::EndReached() const
 {
     return endReached;
@@ -182,12 +198,10 @@ int SequenceReader::tickTrackNotes(uint8_t track_idx, std::bitset<NUM_NOTES>& ac
     int active = 0;
 
     auto tickFunc = [&](auto& channels) {
-        for (auto& chn : channels) {
-            if (chn.GetTrackIdx() == track_idx) {
-                if (chn.TickNote()) {
-                    active++;
-                    backBuffer[chn.GetNote().midiKeyTrackData % 128] = true;
-                }
+        for (auto& chn : channels.InTrack(track_idx)) {
+            if (chn.TickNote()) {
+                active++;
+                backBuffer[chn.GetNote().midiKeyTrackData % 128] = true;
             }
         }
     };
@@ -205,13 +219,11 @@ int SequenceReader::tickTrackNotes(uint8_t track_idx, std::bitset<NUM_NOTES>& ac
 void SequenceReader::setTrackPV(uint8_t track_idx, uint16_t vol, int16_t pan, int16_t pitch, bool updateVolume, bool updatePitch)
 {
     auto setFunc = [&](auto& channels) {
-        for (auto& chn : channels) {
-            if (chn.GetTrackIdx() == track_idx) {
-                if (updateVolume)
-                    chn.SetVol(vol, pan);
-                if (updatePitch)
-                    chn.SetPitch(pitch);
-            }
+        for (auto& chn : channels.InTrack(track_idx)) {
+            if (updateVolume)
+                chn.SetVol(vol, pan);
+            if (updatePitch)
+                chn.SetPitch(pitch);
         }
     };
 
@@ -229,15 +241,20 @@ void SequenceReader::cmdPlayNote(uint8_t cmd, uint8_t trackIdx)
 
     trk.lastNoteLen = noteLut.at(cmd);
 
-    // parse command from track data
-    if (rom.ReadU8(trk.pos) < 0x80) {
-        trk.lastNoteKey = rom.ReadU8(trk.pos++);
+    /* parse command from track data, there are at most 3 arguments (fewer
+     * at the very end of the ROM, the next command read fails there) */
+    const RomView args = rom.View(trk.pos, std::min<size_t>(3, rom.Size() - trk.pos));
+    if (args.Size() > 0 && args.ReadU8(0) < 0x80) {
+        trk.lastNoteKey = args.ReadU8(0);
+        trk.pos++;
 
-        if (rom.ReadU8(trk.pos) < 0x80) {
-            trk.lastNoteVel = rom.ReadU8(trk.pos++);
+        if (args.Size() > 1 && args.ReadU8(1) < 0x80) {
+            trk.lastNoteVel = args.ReadU8(1);
+            trk.pos++;
 
-            if (rom.ReadU8(trk.pos) < 0x80) {
-                trk.lastNoteLen += rom.ReadU8(trk.pos++);
+            if (args.Size() > 2 && args.ReadU8(2) < 0x80) {
+                trk.lastNoteLen += args.ReadU8(2);
+                trk.pos++;
             }
         }
     }
@@ -250,14 +267,16 @@ void SequenceReader::cmdPlayNote(uint8_t cmd, uint8_t trackIdx)
     if (trk.lfodl != 0)
         trk.ResetLfoValue();
 
+    const SoundBank::Instrument& instr = ctx.bnk.GetInstrument(trk.prog, trk.lastNoteKey);
+
     // initialize note data
     Note note;
     note.length = trk.lastNoteLen;
     note.midiKeyTrackData = trk.lastNoteKey;
-    note.midiKeyPitch = ctx.bnk.GetMidiKey(trk.prog, trk.lastNoteKey);
+    note.midiKeyPitch = instr.midiKey;
     note.velocity = trk.lastNoteVel;
     note.priority = trk.priority;
-    note.rhythmPan = ctx.bnk.GetPan(trk.prog, trk.lastNoteKey) * 2;
+    note.rhythmPan = instr.pan * 2;
     note.pseudoEchoVol = trk.pseudoEchoVol;
     note.pseudoEchoLen = trk.pseudoEchoLen;
     note.trackIdx = trackIdx;
@@ -302,18 +321,20 @@ void SequenceReader::cmdPlayNote(uint8_t cmd, uint8_t trackIdx)
     };
 
     // enqueue actual note
-    switch (ctx.bnk.GetInstrType(trk.prog, trk.lastNoteKey)) {
+    switch (instr.type) {
         case InstrType::PCM:
             ctx.sndChannels.emplace_back(
-                    ctx.bnk.GetSampInfo(trk.prog, trk.lastNoteKey),
-                    ctx.bnk.GetADSR(trk.prog, trk.lastNoteKey),
+                    ctx.rsPool,
+                    instr.sampInfo,
+                    instr.adsr,
                     note,
                     false);
             break;
         case InstrType::PCM_FIXED:
             ctx.sndChannels.emplace_back(
-                    ctx.bnk.GetSampInfo(trk.prog, trk.lastNoteKey),
-                    ctx.bnk.GetADSR(trk.prog, trk.lastNoteKey),
+                    ctx.rsPool,
+                    instr.sampInfo,
+                    instr.adsr,
                     note,
                     true);
             break;
@@ -321,26 +342,29 @@ void SequenceReader::cmdPlayNote(uint8_t cmd, uint8_t trackIdx)
             if (!cgbPolyphonySuppressFunc(ctx.sq1Channels))
                 return;
             ctx.sq1Channels.emplace_back(
-                    ctx.bnk.GetCGBDef(trk.prog, trk.lastNoteKey).wd,
-                    ctx.bnk.GetADSR(trk.prog, trk.lastNoteKey),
+                    ctx.rsPool,
+                    instr.cgbDef.wd,
+                    instr.adsr,
                     note,
-                    ctx.bnk.GetSweep(trk.prog, trk.lastNoteKey));
+                    instr.sweep);
             break;
         case InstrType::SQ2:
             if (!cgbPolyphonySuppressFunc(ctx.sq2Channels))
                 return;
             ctx.sq2Channels.emplace_back(
-                    ctx.bnk.GetCGBDef(trk.prog, trk.lastNoteKey).wd,
-                    ctx.bnk.GetADSR(trk.prog, trk.lastNoteKey),
+                    ctx.rsPool,
+                    instr.cgbDef.wd,
+                    instr.adsr,
                     note,
-                    0);
+                    uint8_t(0));
             break;
         case InstrType::WAVE:
             if (!cgbPolyphonySuppressFunc(ctx.waveChannels))
                 return;
             ctx.waveChannels.emplace_back(
-                    ctx.bnk.GetCGBDef(trk.prog, trk.lastNoteKey).wavePtr,
-                    ctx.bnk.GetADSR(trk.prog, trk.lastNoteKey),
+                    ctx.rsPool,
+                    instr.cgbDef.wavePtr,
+                    instr.adsr,
                     note,
                     cm.GetCfg().GetAccurateCh3Volume());
             break;
@@ -348,8 +372,9 @@ void SequenceReader::cmdPlayNote(uint8_t cmd, uint8_t trackIdx)
             if (!cgbPolyphonySuppressFunc(ctx.noiseChannels))
                 return;
             ctx.noiseChannels.emplace_back(
-                    ctx.bnk.GetCGBDef(trk.prog, trk.lastNoteKey).np,
-                    ctx.bnk.GetADSR(trk.prog, trk.lastNoteKey),
+                    ctx.rsPool,
+                    instr.cgbDef.np,
+                    instr.adsr,
                     note);
             break;
         case InstrType::INVALID:
@@ -501,8 +526,8 @@ void SequenceReader::cmdPlayCommand(uint8_t cmd, uint8_t trackIdx)
                 trk.lastNoteKey = key;
             }
             auto stopFunc = [&](auto& channels) {
-                for (auto& chn : channels) {
-                    if (chn.GetTrackIdx() == trackIdx && chn.GetNote().midiKeyTrackData == key) {
+                for (auto& chn : channels.InTrack(trackIdx)) {
+                    if (chn.GetNote().midiKeyTrackData == key) {
                         chn.Release();
                         break;
                     }
@@ -524,10 +549,8 @@ void SequenceReader::cmdPlayCommand(uint8_t cmd, uint8_t trackIdx)
 void SequenceReader::cmdPlayFine(uint8_t trackIdx)
 {
     auto stopFunc = [&](auto& channels) {
-        for (auto& chn : channels) {
-            if (chn.GetTrackIdx() == trackIdx)
-                chn.Release();
-        }
+        for (auto& chn : channels.InTrack(trackIdx))
+            chn.Release();
     };
     stopFunc(ctx.sndChannels);
     stopFunc(ctx.sq1Channels);
@@ -542,9 +565,11 @@ void SequenceReader::cmdPlayMemacc(uint8_t trackIdx)
     Rom& rom = Rom::Instance();
     Track& trk = ctx.seq.tracks[trackIdx];
 
-    uint8_t op = rom.ReadU8(trk.pos++);
-    uint8_t& memory = ctx.seq.memaccArea[rom.ReadU8(trk.pos++)];
-    uint8_t data = rom.ReadU8(trk.pos++);
+    const RomView args = rom.View(trk.pos, 3);
+    trk.pos += 3;
+    uint8_t op = args.ReadU8(0);
+    uint8_t& memory = ctx.seq.memaccArea[args.ReadU8(1)];
+    uint8_t data = args.ReadU8(2);
 
     switch (op) {
     case 0:
@@ -17,6 +17,7 @@ public:
     SequenceReader& operator=(const SequenceReader&) = delete;
 
     void Process();
+    size_t GetMicroframesWithoutTick() const;
     bool EndReached() const;
     void Restart();
     void SetSpeedFactor(float speedFactor);
@@ -116,6 +116,12 @@ SongEntry *SonglistGUI::GetSong()
     return &songlist[cursorPos];
 }
 
+void SonglistGUI::SetSongLengths(const std::vector<double>& lengths)
+{
+    songLengths = lengths;
+    update();
+}
+
 /*
  * -- private --
  */
@@ -153,8 +159,16 @@ void SonglistGUI::update()
             wattrset(winPtr, COLOR_PAIR(static_cast<int>(Color::LIST_ENTRY)));
         // generate list of songs
         if (i + viewPos < songlist.size()) {
-            mvwprintw(winPtr, (int)(height - contentHeight + (uint32_t)i), 0, "%-*.*s", 
-                    width, width, songlist[i + viewPos].name.c_str());
+            const SongEntry& entry = songlist[i + viewPos];
+            // show the length on the right, if it is known and there is space for it
+            char length[16] = "";
+            if (entry.GetUID() < songLengths.size() && width >= 16) {
+                unsigned seconds = static_cast<unsigned>(songLengths[entry.GetUID()] + 0.5);
+                snprintf(length, sizeof(length), " %u:%02u", seconds / 60, seconds % 60);
+            }
+            int nameWidth = static_cast<int>(width) - static_cast<int>(strlen(length));
+            mvwprintw(winPtr, (int)(height - contentHeight + (uint32_t)i), 0, "%-*.*s%s", 
+                    nameWidth, nameWidth, entry.name.c_str(), length);
         } else {
             mvwprintw(winPtr, (int)(height - contentHeight + (uint32_t)i), 0, "%-*.*s", 
                     width, width, "");
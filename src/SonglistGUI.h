@@ -17,6 +17,8 @@ public:
     virtual void RemoveSong();
     virtual void ClearSongs();
     virtual SongEntry *GetSong();
+    // estimated lengths in seconds, indexed by song UID
+    void SetSongLengths(const std::vector<double>& lengths);
     void Enter();
     virtual void Leave();
     void ScrollDown();
@@ -36,4 +38,5 @@ protected:
     bool cursorVisible;
 private:
     std::vector<SongEntry> songlist;
+    std::vector<double> songLengths;
 };
@@ -9,33 +9,18 @@
 #include "Util.h"
 #include "Xcept.h"
 #include "ConfigManager.h"
+#include "Profiler.h"
 
 /*
  * public SoundChannel
  */
 
-SoundChannel::SoundChannel(SampleInfo sInfo, ADSR env, const Note& note, bool fixed)
+SoundChannel::SoundChannel(ResamplerPool& rsPool, SampleInfo sInfo, ADSR env, const Note& note, bool fixed)
     : env(env), note(note), sInfo(sInfo), fixed(fixed) 
 {
     GameConfig& cfg = ConfigManager::Instance().GetCfg();
-    ResamplerType t = fixed ? cfg.GetResTypeFixed() : cfg.GetResType();
-    switch (t) {
-    case ResamplerType::NEAREST:
-        this->rs = std::make_unique<NearestResampler>();
-        break;
-    case ResamplerType::LINEAR:
-        this->rs = std::make_unique<LinearResampler>();
-        break;
-    case ResamplerType::SINC:
-        this->rs = std::make_unique<SincResampler>();
-        break;
-    case ResamplerType::BLEP:
-        this->rs = std::make_unique<BlepResampler>();
-        break;
-    case ResamplerType::BLAMP:
-        this->rs = std::make_unique<BlampResampler>();
-        break;
-    }
+    this->resType = fixed ? cfg.GetResTypeFixed() : cfg.GetResType();
+    this->rs = rsPool.Get(resType);
 
     // Golden Sun's synth instruments are marked by having a length of zero and a loop of zero
     if (sInfo.loopEnabled == true && sInfo.loopPos == 0 && sInfo.endPos == 0) {
@@ -56,6 +41,11 @@ SoundChannel::SoundChannel(SampleInfo sInfo, ADSR env, const Note& note, bool fi
     }
     this->levelMPTcompressed = 0;
     this->shiftMPTcompressed = 0x38;
+
+    if (this->isMPTcompressed)
+        this->resampleFunc = selectResampleFunc<sampleFetchCallbackMPTDecomp>(resType);
+    else
+        this->resampleFunc = selectResampleFunc<sampleFetchCallback>(resType);
 }
 
 void SoundChannel::Process(sample *buffer, size_t numSamples, const MixingArgs& args)
@@ -67,23 +57,7 @@ void SoundChannel::Process(sample *buffer, size_t numSamples, const MixingArgs&
         return;
 
     float samplesPerBufferInv = 1.0f / float(numSamples);
-
-    VolumeFade vol = getVol();
-    vol.fromVolLeft *= args.vol;
-    vol.fromVolRight *= args.vol;
-    vol.toVolLeft *= args.vol;
-    vol.toVolRight *= args.vol;
-
-    ProcArgs cargs;
-    cargs.lVolStep = (vol.toVolLeft - vol.fromVolLeft) * samplesPerBufferInv;
-    cargs.rVolStep = (vol.toVolRight - vol.fromVolRight) * samplesPerBufferInv;
-    cargs.lVol = vol.fromVolLeft;
-    cargs.rVol = vol.fromVolRight;
-
-    if (fixed && !isGS)
-        cargs.interStep = float(args.fixedModeRate) * args.sampleRateInv;
-    else 
-        cargs.interStep = freq * args.sampleRateInv;
+    ProcArgs cargs = getProcArgs(numSamples, args);
 
     if (isGS) {
         cargs.interStep /= 64.f; // different scale for GS
@@ -101,6 +75,54 @@ void SoundChannel::Process(sample *buffer, size_t numSamples, const MixingArgs&
     updateVolFade();
 }
 
+/*
+ * Renders several microframes at once. The caller guarantees that no sequencer tick happens in between,
+ * so pitch and volume only change by the envelope and the whole run can be resampled with one call.
+ */
+void SoundChannel::ProcessMicroframes(sample *buffer, size_t numMicroframes, const size_t *microframeSamples, const MixingArgs& args)
+{
+    PROFILE_SCOPE(isGS ? ProfileStage::PCM_SYNTH :
+            static_cast<ProfileStage>(static_cast<size_t>(ProfileStage::PCM_NEAREST) + static_cast<size_t>(resType)));
+
+    // synth instruments depend on per microframe state, so let them take the regular path
+    if (isGS || numMicroframes <= 1) {
+        for (size_t i = 0; i < numMicroframes; i++) {
+            Process(buffer, microframeSamples[i], args);
+            buffer += microframeSamples[i];
+        }
+        return;
+    }
+
+    stepEnvelope();
+    if (GetState() == EnvState::DEAD)
+        return;
+
+    size_t numSamples = 0;
+    for (size_t i = 0; i < numMicroframes; i++)
+        numSamples += microframeSamples[i];
+    if (numSamples == 0)
+        return;
+
+    float outBuffer[numSamples];
+    bool running = resample(outBuffer, numSamples, getProcArgs(microframeSamples[0], args).interStep);
+
+    const float *samples = outBuffer;
+    for (size_t i = 0; i < numMicroframes; i++) {
+        if (i > 0) {
+            stepEnvelope();
+            if (GetState() == EnvState::DEAD)
+                break;
+        }
+        ProcArgs cargs = getProcArgs(microframeSamples[i], args);
+        mixSamples(buffer, samples, microframeSamples[i], cargs);
+        buffer += microframeSamples[i];
+        samples += microframeSamples[i];
+        updateVolFade();
+    }
+    if (!running)
+        Kill();
+}
+
 uint8_t SoundChannel::GetTrackIdx() const
 {
     return note.trackIdx;
@@ -270,21 +292,64 @@ void SoundChannel::updateVolFade()
  * private SoundChannel
  */
 
-void SoundChannel::processNormal(sample *buffer, size_t numSamples, ProcArgs& cargs) {
-    if (numSamples == 0)
-        return;
-    float outBuffer[numSamples];
+SoundChannel::ProcArgs SoundChannel::getProcArgs(size_t numSamples, const MixingArgs& args) const
+{
+    float samplesPerBufferInv = 1.0f / float(numSamples);
 
-    bool running;
-    if (this->isMPTcompressed) {
-        running = rs->Process(outBuffer, numSamples, cargs.interStep, sampleFetchCallbackMPTDecomp, this);
-    } else {
-        running = rs->Process(outBuffer, numSamples, cargs.interStep, sampleFetchCallback, this);
+    VolumeFade vol = getVol();
+    vol.fromVolLeft *= args.vol;
+    vol.fromVolRight *= args.vol;
+    vol.toVolLeft *= args.vol;
+    vol.toVolRight *= args.vol;
+
+    ProcArgs cargs;
+    cargs.lVolStep = (vol.toVolLeft - vol.fromVolLeft) * samplesPerBufferInv;
+    cargs.rVolStep = (vol.toVolRight - vol.fromVolRight) * samplesPerBufferInv;
+    cargs.lVol = vol.fromVolLeft;
+    cargs.rVol = vol.fromVolRight;
+
+    if (fixed && !isGS)
+        cargs.interStep = float(args.fixedModeRate) * args.sampleRateInv;
+    else 
+        cargs.interStep = freq * args.sampleRateInv;
+    return cargs;
+}
+
+bool SoundChannel::resample(float *outBuffer, size_t numSamples, float interStep)
+{
+    return resampleFunc(*rs, outBuffer, numSamples, interStep, this);
+}
+
+template<typename R, res_data_fetch_cb cbPtr>
+bool SoundChannel::resampleWith(Resampler& rs, float *outBuffer, size_t numSamples, float interStep, SoundChannel *chn)
+{
+    StaticFetchSource<cbPtr> src{chn};
+    return static_cast<R&>(rs).ProcessT(outBuffer, numSamples, interStep, src);
+}
+
+template<res_data_fetch_cb cbPtr>
+SoundChannel::resample_func SoundChannel::selectResampleFunc(ResamplerType t)
+{
+    switch (t) {
+    case ResamplerType::NEAREST:
+        return resampleWith<NearestResampler, cbPtr>;
+    case ResamplerType::LINEAR:
+        return resampleWith<LinearResampler, cbPtr>;
+    case ResamplerType::SINC:
+        return resampleWith<SincResampler, cbPtr>;
+    case ResamplerType::BLEP:
+        return resampleWith<BlepResampler, cbPtr>;
+    case ResamplerType::BLAMP:
+        return resampleWith<BlampResampler, cbPtr>;
     }
+    throw Xcept("Invalid resampler type");
+}
 
+void SoundChannel::mixSamples(sample *buffer, const float *samples, size_t numSamples, ProcArgs& cargs)
+{
     size_t i = 0;
     do {
-        float samp = outBuffer[i++];
+        float samp = samples[i++];
 
         buffer->left  += samp * cargs.lVol;
         buffer->right += samp * cargs.rVol;
@@ -292,6 +357,15 @@ void SoundChannel::processNormal(sample *buffer, size_t numSamples, ProcArgs& ca
         cargs.lVol += cargs.lVolStep;
         cargs.rVol += cargs.rVolStep;
     } while (--numSamples > 0);
+}
+
+void SoundChannel::processNormal(sample *buffer, size_t numSamples, ProcArgs& cargs) {
+    if (numSamples == 0)
+        return;
+    float outBuffer[numSamples];
+
+    bool running = resample(outBuffer, numSamples, cargs.interStep);
+    mixSamples(buffer, outBuffer, numSamples, cargs);
     if (!running)
         Kill();
 }
@@ -397,14 +471,10 @@ void SoundChannel::processTri(sample *buffer, size_t numSamples, ProcArgs& cargs
     } while (--numSamples > 0);
 }
 
-bool SoundChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata)
+bool SoundChannel::sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata)
 {
-    if (fetchBuffer.size() >= samplesRequired)
-        return true;
     SoundChannel *_this = static_cast<SoundChannel *>(cbdata);
-    size_t samplesToFetch = samplesRequired - fetchBuffer.size();
-    size_t i = fetchBuffer.size();
-    fetchBuffer.resize(samplesRequired);
+    size_t i = 0;
 
     do {
         size_t samplesTilLoop = _this->sInfo.endPos - _this->pos;
@@ -419,7 +489,7 @@ bool SoundChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t s
             if (_this->sInfo.loopEnabled) {
                 _this->pos = _this->sInfo.loopPos;
             } else {
-                std::fill(fetchBuffer.begin() + i, fetchBuffer.end(), 0.0f);
+                std::fill(fetchBuffer + i, fetchBuffer + i + samplesToFetch, 0.0f);
                 return false;
             }
         }
@@ -427,14 +497,10 @@ bool SoundChannel::sampleFetchCallback(std::vector<float>& fetchBuffer, size_t s
     return true;
 }
 
-bool SoundChannel::sampleFetchCallbackMPTDecomp(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata)
+bool SoundChannel::sampleFetchCallbackMPTDecomp(float *fetchBuffer, size_t samplesToFetch, void *cbdata)
 {
-    if (fetchBuffer.size() >= samplesRequired)
-        return true;
     SoundChannel *_this = static_cast<SoundChannel *>(cbdata);
-    size_t samplesToFetch = samplesRequired - fetchBuffer.size();
-    size_t i = fetchBuffer.size();
-    fetchBuffer.resize(samplesRequired);
+    size_t i = 0;
 
     do {
         size_t samplesTilLoop = _this->sInfo.endPos - _this->pos;
@@ -471,7 +537,7 @@ bool SoundChannel::sampleFetchCallbackMPTDecomp(std::vector<float>& fetchBuffer,
 
         if (_this->pos >= _this->sInfo.endPos) {
             // MPT compressed sample cannot loop
-            std::fill(fetchBuffer.begin() + i, fetchBuffer.end(), 0.0f);
+            std::fill(fetchBuffer + i, fetchBuffer + i + samplesToFetch, 0.0f);
             return false;
         }
     } while (samplesToFetch > 0);
@@ -10,6 +10,9 @@
 class SoundChannel
 {
 private:
+    // resampler and sample source specific render function, selected on construction
+    typedef bool (*resample_func)(Resampler& rs, float *outBuffer, size_t numSamples, float interStep, SoundChannel *chn);
+
     struct ProcArgs
     {
         float lVol;
@@ -19,11 +22,12 @@ private:
         float interStep;
     };
 public:
-    SoundChannel(SampleInfo sInfo, ADSR env, const Note& note, bool fixed);
+    SoundChannel(ResamplerPool& rsPool, SampleInfo sInfo, ADSR env, const Note& note, bool fixed);
     SoundChannel(const SoundChannel&) = delete;
     SoundChannel& operator=(const SoundChannel&) = delete;
 
     void Process(sample *buffer, size_t numSamples, const MixingArgs& args);
+    void ProcessMicroframes(sample *buffer, size_t numMicroframes, const size_t *microframeSamples, const MixingArgs& args);
     uint8_t GetTrackIdx() const;
     void SetVol(uint16_t vol, int16_t pan);
     const Note& GetNote() const;
@@ -36,14 +40,22 @@ private:
     void stepEnvelope();
     void updateVolFade();
     VolumeFade getVol() const;
+    ProcArgs getProcArgs(size_t numSamples, const MixingArgs& args) const;
+    bool resample(float *outBuffer, size_t numSamples, float interStep);
+    template<typename R, res_data_fetch_cb cbPtr>
+    static bool resampleWith(Resampler& rs, float *outBuffer, size_t numSamples, float interStep, SoundChannel *chn);
+    template<res_data_fetch_cb cbPtr>
+    static resample_func selectResampleFunc(ResamplerType t);
+    void mixSamples(sample *buffer, const float *samples, size_t numSamples, ProcArgs& cargs);
     void processNormal(sample *buffer, size_t numSamples, ProcArgs& cargs);
     void processModPulse(sample *buffer, size_t numSamples, ProcArgs& cargs, float nBlocksReciprocal);
     void processSaw(sample *buffer, size_t numSamples, ProcArgs& cargs);
     void processTri(sample *buffer, size_t numSamples, ProcArgs& cargs);
-    static bool sampleFetchCallback(std::vector<float>& fetchBuffer, size_t samplesRequired, void *cbdata);
-    static bool sampleFetchCallbackMPTDecomp(std::vector<float>& fetchBuffer, size_t samplesRequires, void *cbdata);
+    static bool sampleFetchCallback(float *fetchBuffer, size_t samplesToFetch, void *cbdata);
+    static bool sampleFetchCallbackMPTDecomp(float *fetchBuffer, size_t samplesToFetch, void *cbdata);
 
-    std::unique_ptr<Resampler> rs;
+    ResamplerPool::Ptr rs;
+    resample_func resampleFunc = nullptr;
     uint32_t pos = 0;
     float interPos = 0.0f;
     float freq = 0.0f;
@@ -52,6 +64,7 @@ private:
     SampleInfo sInfo;
     bool stop = false;
     bool fixed;
+    ResamplerType resType;
     bool isGS;              // is Golden Sun synth
     bool isMPTcompressed;   // is Mario Power Tennis compressed
     int16_t levelMPTcompressed;
@@ -17,46 +17,38 @@
 void SoundBank::Init(size_t bankPos)
 {
     this->bankPos = bankPos;
+    // keep the memory for the next song
+    for (std::vector<Instrument>& program : instruments)
+        program.clear();
 }
 
-InstrType SoundBank::GetInstrType(uint8_t instrNum, uint8_t midiKey)
+const SoundBank::Instrument& SoundBank::GetInstrument(uint8_t instrNum, uint8_t midiKey)
 {
-    Rom& rom = Rom::Instance();
-    size_t pos = instrPos(instrNum, midiKey);
+    assert(instrNum < 128 && midiKey < 128);
+    std::vector<Instrument>& program = instruments[instrNum];
+    if (program.empty())
+        program.resize(128);
+    Instrument& instr = program[midiKey];
+    // instruments which fail to decode aren't cached and fail again next time
+    if (!instr.decoded)
+        instr = decode(instrNum, midiKey);
+    return instr;
+}
 
-    switch (rom.ReadU8(pos + 0x0)) {
-    case 0x0:
-        return InstrType::PCM;
-    case 0x1:
-        return InstrType::SQ1;
-    case 0x2:
-        return InstrType::SQ2;
-    case 0x3:
-        return InstrType::WAVE;
-    case 0x4:
-        return InstrType::NOISE;
-    case 0x8:
-        return InstrType::PCM_FIXED;
-    case 0x9:
-        return InstrType::SQ1;
-    case 0xA:
-        return InstrType::SQ2;
-    case 0xB:
-        return InstrType::WAVE;
-    case 0xC:
-        return InstrType::NOISE;
-    default:
-        return InstrType::INVALID;
-    }
+InstrType SoundBank::GetInstrType(uint8_t instrNum, uint8_t midiKey)
+{
+    return instrType(instrView(instrPos(instrNum, midiKey)));
 }
 
 uint8_t SoundBank::GetMidiKey(uint8_t instrNum, uint8_t midiKey)
 {
     Rom& rom = Rom::Instance();
+    const size_t pos = bankPos + instrNum * 12;
+    const RomView instr = instrView(pos);
 
-    if (rom.ReadU8(bankPos + instrNum * 12 + 0) == 0x80) {
-        size_t subBankPos = rom.ReadAgbPtrToPos(bankPos + instrNum * 12 + 0x4);
-        return rom.ReadU8(subBankPos + midiKey * 12 + 1);
+    if (instr.ReadU8(0) == 0x80) {
+        size_t subBankPos = rom.AgbPtrToPos(instr.ReadU32(4), pos + 4);
+        return instrView(subBankPos + midiKey * 12).ReadU8(1);
     } else {
         return midiKey;
     }
@@ -64,14 +56,14 @@ uint8_t SoundBank::GetMidiKey(uint8_t instrNum, uint8_t midiKey)
 
 int8_t SoundBank::GetPan(uint8_t instrNum, uint8_t midiKey)
 {
-    size_t pos = instrPos(instrNum, midiKey);
+    const RomView instr = instrView(instrPos(instrNum, midiKey));
 
     // not strictly correct, pan should only be set for drum table instruments
-    InstrType t = GetInstrType(instrNum, midiKey);
+    InstrType t = instrType(instr);
     if (t != InstrType::PCM && t != InstrType::PCM_FIXED)
         return 0;
 
-    uint8_t pan = Rom::Instance().ReadU8(pos + 3);
+    uint8_t pan = instr.ReadU8(3);
     if (pan & 0x80)
         return static_cast<int8_t>(pan - 0xC0);
     else
@@ -81,11 +73,12 @@ int8_t SoundBank::GetPan(uint8_t instrNum, uint8_t midiKey)
 uint8_t SoundBank::GetSweep(uint8_t instrNum, uint8_t midiKey)
 {
     size_t pos = instrPos(instrNum, midiKey);
-    InstrType t = GetInstrType(instrNum, midiKey);
+    const RomView instr = instrView(pos);
+    InstrType t = instrType(instr);
     if (t != InstrType::SQ1)
         throw Xcept("SoundBank Error: Invalid use of sweep at non SQ1 instrument: [%08X]", pos);
 
-    return Rom::Instance().ReadU8(pos + 3);
+    return instr.ReadU8(3);
 }
 
 CGBDef SoundBank::GetCGBDef(uint8_t instrNum, uint8_t midiKey)
@@ -94,10 +87,11 @@ CGBDef SoundBank::GetCGBDef(uint8_t instrNum, uint8_t midiKey)
     CGBDef def;
 
     size_t pos = instrPos(instrNum, midiKey);
-    InstrType t = GetInstrType(instrNum, midiKey);
+    const RomView instr = instrView(pos);
+    InstrType t = instrType(instr);
 
     if (t == InstrType::SQ1 || t == InstrType::SQ2) {
-        uint32_t dutyCycle = rom.ReadU32(pos + 4);
+        uint32_t dutyCycle = instr.ReadU32(4);
         switch (dutyCycle) {
         case 0: def.wd = WaveDuty::D12; break;
         case 1: def.wd = WaveDuty::D25; break;
@@ -107,9 +101,12 @@ CGBDef SoundBank::GetCGBDef(uint8_t instrNum, uint8_t midiKey)
             throw Xcept("SoundBank Error: Invalid square wave duty cycle at [%08X+4]=%08X", pos, dutyCycle);
         }
     } else if (t == InstrType::WAVE) {
-        def.wavePtr = static_cast<const uint8_t *>(rom.GetPtr(rom.ReadAgbPtrToPos(pos + 4)));
+        size_t wavePos = rom.AgbPtrToPos(instr.ReadU32(4), pos + 4);
+        // the wave channel reads 16 bytes of samples
+        rom.View(wavePos, 16);
+        def.wavePtr = static_cast<const uint8_t *>(rom.GetPtr(wavePos));
     } else if (t == InstrType::NOISE) {
-        uint32_t noisePatt = rom.ReadU32(pos + 4);
+        uint32_t noisePatt = instr.ReadU32(4);
         switch (noisePatt) {
         case 0: def.np = NoisePatt::FINE; break;
         case 1: def.np = NoisePatt::ROUGH; break;
@@ -128,54 +125,126 @@ SampleInfo SoundBank::GetSampInfo(uint8_t instrNum, uint8_t midiKey)
     Rom& rom = Rom::Instance();
 
     size_t pos = instrPos(instrNum, midiKey);
-    InstrType t = GetInstrType(instrNum, midiKey);
+    const RomView instr = instrView(pos);
+    InstrType t = instrType(instr);
     if (t != InstrType::PCM && t != InstrType::PCM_FIXED)
         throw Xcept("SoundBank Error: Cannot get sample info of non PCM instrument: [%08X]", pos);
 
-    size_t samplePos = rom.ReadAgbPtrToPos(pos + 4);
+    size_t samplePos = rom.AgbPtrToPos(instr.ReadU32(4), pos + 4);
+    // sample header, the sample data follows it
+    const RomView sample = rom.View(samplePos, 16);
 
-    bool loopEnabled = rom.ReadU8(samplePos + 3) & 0xC0;
-    if (rom.ReadU8(samplePos) != 0)
+    bool loopEnabled = sample.ReadU8(3) & 0xC0;
+    if (sample.ReadU8(0) != 0)
         throw Xcept("Sample Error: Unknown/unsupported sample mode: [%08X]=%02X, instrument: [%08X]",
-                samplePos, rom.ReadU8(samplePos), pos);
+                samplePos, sample.ReadU8(0), pos);
 
-    float midCfreq = static_cast<float>(rom.ReadU32(samplePos + 4)) / 1024.0f;
-    uint32_t loopPos = rom.ReadU32(samplePos + 8);
-    uint32_t endPos = rom.ReadU32(samplePos + 12);
+    float midCfreq = static_cast<float>(sample.ReadU32(4)) / 1024.0f;
+    uint32_t loopPos = sample.ReadU32(8);
+    uint32_t endPos = sample.ReadU32(12);
     const int8_t *samplePtr = static_cast<const int8_t *>(rom.GetPtr(samplePos + 16));
     return SampleInfo(samplePtr, midCfreq, loopEnabled, loopPos, endPos);
 }
 
 ADSR SoundBank::GetADSR(uint8_t instrNum, uint8_t midiKey)
 {
-    Rom& rom = Rom::Instance();
-
     size_t pos = instrPos(instrNum, midiKey);
-    InstrType t = GetInstrType(instrNum, midiKey);
+    const RomView instr = instrView(pos);
+    InstrType t = instrType(instr);
     if (t == InstrType::INVALID)
         throw Xcept("SoundBank Error: Cannot get ADSR for unknown instrument type: [%08X]", pos);
 
     ADSR adsr;
-    adsr.att = rom.ReadU8(pos + 8);
-    adsr.dec = rom.ReadU8(pos + 9);
-    adsr.sus = rom.ReadU8(pos + 10);
-    adsr.rel = rom.ReadU8(pos + 11);
+    adsr.att = instr.ReadU8(8);
+    adsr.dec = instr.ReadU8(9);
+    adsr.sus = instr.ReadU8(10);
+    adsr.rel = instr.ReadU8(11);
     return adsr;
 }
 
+/*
+ * private SoundBank
+ */
+
+SoundBank::Instrument SoundBank::decode(uint8_t instrNum, uint8_t midiKey)
+{
+    Instrument instr;
+    instr.midiKey = GetMidiKey(instrNum, midiKey);
+    instr.pan = GetPan(instrNum, midiKey);
+    instr.type = GetInstrType(instrNum, midiKey);
+
+    switch (instr.type) {
+    case InstrType::PCM:
+    case InstrType::PCM_FIXED:
+        instr.sampInfo = GetSampInfo(instrNum, midiKey);
+        instr.adsr = GetADSR(instrNum, midiKey);
+        break;
+    case InstrType::SQ1:
+        instr.sweep = GetSweep(instrNum, midiKey);
+        [[fallthrough]];
+    case InstrType::SQ2:
+    case InstrType::WAVE:
+    case InstrType::NOISE:
+        instr.cgbDef = GetCGBDef(instrNum, midiKey);
+        instr.adsr = GetADSR(instrNum, midiKey);
+        break;
+    case InstrType::INVALID:
+        break;
+    }
+
+    instr.decoded = true;
+    return instr;
+}
+
+RomView SoundBank::instrView(size_t pos)
+{
+    // all instrument records are 12 bytes, this checks the bounds for all reads of a record
+    return Rom::Instance().View(pos, 12);
+}
+
+InstrType SoundBank::instrType(const RomView& instr)
+{
+    switch (instr.ReadU8(0x0)) {
+    case 0x0:
+        return InstrType::PCM;
+    case 0x1:
+        return InstrType::SQ1;
+    case 0x2:
+        return InstrType::SQ2;
+    case 0x3:
+        return InstrType::WAVE;
+    case 0x4:
+        return InstrType::NOISE;
+    case 0x8:
+        return InstrType::PCM_FIXED;
+    case 0x9:
+        return InstrType::SQ1;
+    case 0xA:
+        return InstrType::SQ2;
+    case 0xB:
+        return InstrType::WAVE;
+    case 0xC:
+        return InstrType::NOISE;
+    default:
+        return InstrType::INVALID;
+    }
+}
+
 size_t SoundBank::instrPos(uint8_t instrNum, uint8_t midiKey) {
     Rom& rom = Rom::Instance();
-    uint8_t type = rom.ReadU8(bankPos + instrNum * 12 + 0x0);
+    const size_t pos = bankPos + instrNum * 12;
+    const RomView instr = instrView(pos);
+    uint8_t type = instr.ReadU8(0x0);
 
     if (type == 0x80) {
-        size_t subBankPos = rom.ReadAgbPtrToPos(bankPos + instrNum * 12 + 0x4);
+        size_t subBankPos = rom.AgbPtrToPos(instr.ReadU32(0x4), pos + 0x4);
         return subBankPos + midiKey * 12;
     } else if (type == 0x40) {
-        size_t subBankPos = rom.ReadAgbPtrToPos(bankPos + instrNum * 12 + 0x4);
-        size_t keyMapPos = rom.ReadAgbPtrToPos(bankPos + instrNum * 12 + 0x8);
+        size_t subBankPos = rom.AgbPtrToPos(instr.ReadU32(0x4), pos + 0x4);
+        size_t keyMapPos = rom.AgbPtrToPos(instr.ReadU32(0x8), pos + 0x8);
         return subBankPos + rom.ReadU8(keyMapPos + midiKey) * 12;
     } else {
-        return bankPos + instrNum * 12;
+        return pos;
     }
 }
 
@@ -306,28 +375,28 @@ std::vector<SongTable> SongTable::ScanForTables()
 {
     Rom& rom = Rom::Instance();
     std::vector<SongTable> tables;
+    // only built once the first candidate is found, most ROMs have very few
+    std::vector<bool> referenced;
 
     for (size_t i = 0x200; i < rom.Size(); i += 4) {
         bool validEntries = true;
         size_t location = i;
         size_t j = 0;
         for (j = 0; j < MIN_SONG_NUM; j++) {
-            if (!validateTableEntry(i + j * 8)) {
+            if (!plausibleTableEntry(i + j * 8) || !validateTableEntry(i + j * 8)) {
                 i += j * 8;
                 validEntries = false;
                 break;
             }
         }
         if (validEntries) {
+            if (referenced.empty())
+                referenced = findReferences();
             // before returning, check if reference to song table exists
-            for (size_t k = 0x200; k < rom.Size() - 3; k += 4) { // -3 due to possible alignment issues
-                size_t value = rom.ReadU32(k) - AGB_MAP_ROM;
-                if (value == location) {
-                    SongTable songTable(location);
-                    j = songTable.GetNumSongs();
-                    tables.push_back(songTable);
-                    break;
-                }
+            if (referenced[location / 4]) {
+                SongTable songTable(location);
+                j = songTable.GetNumSongs();
+                tables.push_back(songTable);
             }
             i += j * 8;
         }
@@ -346,6 +415,11 @@ SongTable::SongTable(size_t songTablePos)
     numSongs = determineNumSongs();
 }
 
+SongTable::SongTable(size_t songTablePos, size_t numSongs)
+    : songTablePos(songTablePos), numSongs(numSongs)
+{
+}
+
 size_t SongTable::GetSongTablePos() {
     return songTablePos;
 }
@@ -362,6 +436,40 @@ size_t SongTable::GetNumSongs() {
  * private
  */
 
+std::vector<bool> SongTable::findReferences()
+{
+    Rom& rom = Rom::Instance();
+
+    /* One bit for each aligned ROM position, set if any aligned word in the ROM
+     * points to it. Song tables are always aligned, so this answers whether a
+     * table is referenced without scanning the ROM again for each candidate. */
+    std::vector<bool> referenced(rom.Size() / 4 + 1, false);
+    for (size_t k = 0x200; k < rom.Size() - 3; k += 4) { // -3 due to possible alignment issues
+        uint32_t offset = rom.ReadU32(k) - AGB_MAP_ROM;
+        if (offset < rom.Size() && offset % 4 == 0)
+            referenced[offset / 4] = true;
+    }
+    return referenced;
+}
+
+bool SongTable::plausibleTableEntry(size_t pos)
+{
+    Rom& rom = Rom::Instance();
+
+    // let validateTableEntry handle the end of the ROM
+    if (pos + 8 > rom.Size())
+        return true;
+
+    /* Quick check of the raw entry bytes, which rejects almost all
+     * positions before the more expensive validation: the pointer has to point
+     * to 0x08xxxxxx or 0x09xxxxxx, both group bytes have to be equal and the
+     * padding bytes have to be zero. */
+    const uint8_t *entry = static_cast<const uint8_t *>(rom.GetPtr(pos));
+    if ((entry[3] & 0xFE) != (AGB_MAP_ROM >> 24))
+        return false;
+    return (entry[4] ^ entry[6]) == 0 && (entry[5] | entry[7]) == 0;
+}
+
 bool SongTable::validateTableEntry(size_t pos)
 {
     Rom& rom = Rom::Instance();
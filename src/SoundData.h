@@ -2,9 +2,11 @@
 
 #include <vector>
 #include <bitset>
+#include <array>
 
 #include "Types.h"
 #include "Constants.h"
+#include "Rom.h"
 
 enum class InstrType { PCM, PCM_FIXED, SQ1, SQ2, WAVE, NOISE, INVALID };
 class SoundBank
@@ -14,8 +16,23 @@ public:
     SoundBank(const SoundBank&) = delete;
     SoundBank& operator=(const SoundBank&) = delete;
 
+    // everything needed to start a note, read from the ROM on first use
+    struct Instrument
+    {
+        InstrType type = InstrType::INVALID;
+        uint8_t midiKey = 0;
+        int8_t pan = 0;
+        uint8_t sweep = 0;      // SQ1 only
+        bool decoded = false;
+        ADSR adsr;              // not for INVALID
+        SampleInfo sampInfo;    // PCM and PCM_FIXED only
+        CGBDef cgbDef{};        // CGB types only
+    };
+
     void Init(size_t bankPos);
 
+    // both arguments must be below 128
+    const Instrument& GetInstrument(uint8_t instrNum, uint8_t midiKey);
     InstrType GetInstrType(uint8_t instrNum, uint8_t midiKey);
     uint8_t GetMidiKey(uint8_t instrNum, uint8_t midiKey);
     int8_t GetPan(uint8_t instrNum, uint8_t midiKey);
@@ -24,8 +41,14 @@ public:
     SampleInfo GetSampInfo(uint8_t instrNum, uint8_t midiKey);
     ADSR GetADSR(uint8_t instrNum, uint8_t midiKey);
 private:
+    Instrument decode(uint8_t instrNum, uint8_t midiKey);
+    static RomView instrView(size_t pos);
+    static InstrType instrType(const RomView& instr);
     size_t instrPos(uint8_t instrNum, uint8_t midiKey);
     size_t bankPos = 0;
+    /* decoded instruments by program and MIDI key, the 128 keys of a program
+     * are only allocated once it is used */
+    std::array<std::vector<Instrument>, 128> instruments;
 };
 
 enum class MODT : int { PITCH = 0, VOL, PAN };
@@ -98,6 +121,8 @@ class SongTable
 public:
     static std::vector<SongTable> ScanForTables();
     SongTable(size_t songTablePos);
+    // for tables which have been scanned before
+    SongTable(size_t songTablePos, size_t numSongs);
     SongTable(const SongTable&) = default;
     SongTable& operator=(const SongTable&) = default;
 
@@ -105,6 +130,8 @@ public:
     size_t GetPosOfSong(uint16_t uid);
     size_t GetNumSongs();
 private:
+    static std::vector<bool> findReferences();
+    static bool plausibleTableEntry(size_t pos);
     static bool validateTableEntry(size_t pos);
     static bool validateSong(size_t songPos);
     size_t determineNumSongs();
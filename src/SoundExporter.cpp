@@ -3,9 +3,15 @@
 #include <chrono>
 #include <climits>
 #include <cmath>
+#include <cstring>
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <future>
 
 #include "SoundExporter.h"
 #include "Util.h"
@@ -15,21 +21,58 @@
 #include "ConfigManager.h"
 #include "PlayerContext.h"
 #include "OS.h"
+#include "RenderCache.h"
+#include "ScanCache.h"
+
+/*
+ * public AudioDigest
+ */
+
+void AudioDigest::Add(const std::vector<sample>& data)
+{
+    hash = Fnv1a64(data.data(), data.size() * sizeof(sample), hash);
+    for (const sample& s : data) {
+        sumSquares += double(s.left) * double(s.left) + double(s.right) * double(s.right);
+        peak = std::max(peak, std::max(std::fabs(s.left), std::fabs(s.right)));
+    }
+    samples += data.size();
+}
+
+double AudioDigest::GetRmsDb() const
+{
+    if (samples == 0 || sumSquares == 0.0)
+        return -INFINITY;
+    return 10.0 * std::log10(sumSquares / double(samples * 2));
+}
+
+double AudioDigest::GetPeakDb() const
+{
+    if (peak == 0.0f)
+        return -INFINITY;
+    return 20.0 * std::log10(double(peak));
+}
 
 /*
  * public SoundExporter
  */
 
-SoundExporter::SoundExporter(SongTable& songTable, bool benchmarkOnly, bool seperate)
-: songTable(songTable), benchmarkOnly(benchmarkOnly), seperate(seperate)
+SoundExporter::SoundExporter(SongTable& songTable, const std::filesystem::path& outputDir, bool benchmarkOnly, bool seperate, size_t numThreads)
+: songTable(songTable), outputDir(outputDir), numThreads(numThreads), benchmarkOnly(benchmarkOnly), seperate(seperate)
 {
 }
 
-void SoundExporter::Export(const std::vector<SongEntry>& entries)
+ExportResult SoundExporter::Export(const std::vector<SongEntry>& entries)
 {
+    // all songs go into one stream or file, one after another
+    const bool continuous = !streamPath.empty() || !playlistFile.empty();
+    if (continuous && seperate)
+        throw Xcept("Separate tracks can't be written to a single stream or file");
+
     /* create directories for file export */
-    std::filesystem::path dir = ConfigManager::Instance().GetWavOutputDir();
-    if (std::filesystem::exists(dir)) {
+    const std::filesystem::path& dir = outputDir;
+    if (benchmarkOnly || !streamPath.empty()) {
+        // no files are written
+    } else if (std::filesystem::exists(dir)) {
         if (!std::filesystem::is_directory(dir)) {
             throw Xcept("Output directory exists but isn't a dir");
         }
@@ -38,110 +81,584 @@ void SoundExporter::Export(const std::vector<SongEntry>& entries)
         throw Xcept("Creating output directory failed");
     }
 
+    /* If there are fewer songs than threads, the remaining threads are used
+     * to mix the tracks of each song in parallel. */
+    size_t numThreads = this->numThreads;
+    if (numThreads == 0)
+        numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0)
+        numThreads = 1;
+    // a stream needs the songs in order, so they are rendered one at a time
+    size_t songThreads = std::max<size_t>(1, std::min(numThreads, entries.size()));
+    if (continuous)
+        songThreads = 1;
+    const size_t trackThreads = numThreads / songThreads;
+
+    /* Rendered blocks (about one second each) are written on a separate thread.
+     * Allow two blocks per file and render thread to be queued. */
+    if (!benchmarkOnly) {
+        const ConfigManager& cm = ConfigManager::Instance();
+        SF_INFO info = fileInfo(static_cast<int>(cm.GetSampleRate()));
+        if (streamPath.empty() && !sf_format_check(&info))
+            throw Xcept("Export format %s isn't supported by libsndfile at %u Hz",
+                    exportFmt2str(cm.GetExportFormat()).c_str(), cm.GetSampleRate());
+
+        const size_t filesPerSong = seperate ? 16 : 1;
+        writer = std::make_unique<ExportWriter>(2 * songThreads * filesPerSong * cm.GetSampleRate());
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    ExportResult result;
+    result.songs.resize(entries.size());
+
+    auto songFileName = [&](size_t i) {
+        std::string fname = entries[i].name;
+        boost::replace_all(fname, "/", "_");
+        char fileName[512];
+        snprintf(fileName, sizeof(fileName), "%s/%03zu - %s", dir.c_str(), i + 1, fname.c_str());
+        return std::string(fileName);
+    };
+
+    /* Songs which have been exported with the same ROM and settings before
+     * are restored from the render cache instead of being rendered again. */
+    std::unique_ptr<RenderCache> cache;
+    if (!benchmarkOnly && !continuous && ConfigManager::Instance().GetExportCache())
+        cache = std::make_unique<RenderCache>(OS::GetCacheDirectory() / "agbplay" / "render");
+    std::vector<std::string> cacheKeys(entries.size());
+
+    /* Estimate the length of all songs with a sequencer only dry run, unless
+     * the scan cache knows them already. That is cheap compared to mixing and
+     * done in parallel as well. */
+    std::vector<size_t> estimatedMicroframes(entries.size());
+    std::atomic<size_t> currentEstimate = 0;
+    runThreads(continuous ? std::max<size_t>(1, std::min(numThreads, entries.size())) : songThreads, [&]() {
+        while (true) {
+            size_t i = currentEstimate++;   // atomic ++
+            if (i >= entries.size())
+                return;
+            SongExportResult& songResult = result.songs[i];
+            if (cache) {
+                cacheKeys[i] = RenderCache::MakeKey(songTable.GetPosOfSong(entries[i].GetUID()), seperate);
+                size_t samples;
+                if (cache->Restore(cacheKeys[i], songFileName(i), songResult.files, samples)) {
+                    songResult.uid = entries[i].GetUID();
+                    songResult.name = entries[i].name;
+                    songResult.fileName = songFileName(i);
+                    songResult.samplesRendered = samples;
+                    songResult.estimatedSeconds = double(samples) / ConfigManager::Instance().GetSampleRate();
+                    songResult.cached = true;
+                    Debug::print("Restored \"%s\" from the render cache", entries[i].name.c_str());
+                    continue;
+                }
+            }
+            estimatedMicroframes[i] = ScanCache::Instance().GetSongMicroframes(songTable, entries[i].GetUID());
+            result.songs[i].estimatedSeconds = double(estimatedMicroframes[i]) / double(AGB_FPS * INTERFRAMES);
+        }
+    });
+    ScanCache::Instance().Save();
+
+    /* Songs are dealt out longest first to per thread queues, like cards. A
+     * thread first works through its own queue from the front and then steals
+     * the shortest remaining song from the back of another queue, so no thread
+     * is left with a long song at the very end. */
+    std::vector<size_t> order;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!result.songs[i].cached)
+            order.push_back(i);
+    }
+    if (!continuous) {
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return result.songs[a].estimatedSeconds > result.songs[b].estimatedSeconds;
+        });
+    }
+
+    struct SongQueue {
+        std::mutex mtx;
+        std::deque<size_t> songs;
+    };
+    std::vector<SongQueue> queues(songThreads);
+    for (size_t i = 0; i < order.size(); i++)
+        queues[i % songThreads].songs.push_back(order[i]);
+
+    auto takeSong = [&](size_t thread, size_t& song) {
+        for (size_t n = 0; n < songThreads; n++) {
+            SongQueue& q = queues[(thread + n) % songThreads];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (q.songs.empty())
+                continue;
+            if (n == 0) {
+                song = q.songs.front();
+                q.songs.pop_front();
+            } else {
+                song = q.songs.back();
+                q.songs.pop_back();
+            }
+            return true;
+        }
+        return false;
+    };
+
     /* setup export thread worker function */
-    std::atomic<size_t> currentSong = 0;
+    std::atomic<size_t> songsStarted = 0;
+    std::atomic<size_t> nextThread = 0;
     std::atomic<size_t> totalBlocksRendered = 0;
 
     std::function<void(void)> threadFunc = [&]() {
         OS::LowerThreadPriority();
-        while (true) {
-            size_t i = currentSong++;   // atomic ++
-            if (i >= entries.size())
-                return;
+        const size_t thread = nextThread++;
+        size_t i;
+        while (takeSong(thread, i)) {
+            const std::string fileName = songFileName(i);
+            const std::string& fname = entries[i].name;
+            Debug::print("%3d %% - Rendering to file: \"%s\"", int(++songsStarted * 100 / order.size()), fname.c_str());
 
-            std::string fname = entries[i].name;
-            boost::replace_all(fname, "/", "_");
-            Debug::print("%3d %% - Rendering to file: \"%s\"", (i + 1) * 100 / entries.size(), fname.c_str());
-            char fileName[512];
-            snprintf(fileName, sizeof(fileName), "%s/%03zu - %s", dir.c_str(), i + 1, fname.c_str());
-            totalBlocksRendered += exportSong(fileName, entries[i].GetUID());
+            SongExportResult& songResult = result.songs[i];
+            auto songStartTime = std::chrono::steady_clock::now();
+            size_t blocks = exportSong(fileName, entries[i].GetUID(), trackThreads, songResult);
+            auto songEndTime = std::chrono::steady_clock::now();
+
+            songResult.uid = entries[i].GetUID();
+            songResult.name = entries[i].name;
+            songResult.fileName = fileName;
+            songResult.samplesRendered = blocks;
+            songResult.seconds = std::chrono::duration<double>(songEndTime - songStartTime).count();
+            totalBlocksRendered += blocks;
+            Debug::print("Rendered \"%s\" (%.1f s of audio) in %.2f s", fname.c_str(),
+                    double(blocks) / ConfigManager::Instance().GetSampleRate(), songResult.seconds);
         }
     };
 
     /* run the actual export threads */
-    auto startTime = std::chrono::high_resolution_clock::now();
 
-    size_t numThreads = std::thread::hardware_concurrency();
-    if (numThreads == 0)
-        numThreads = 1;
-    std::vector<std::thread> workers;
-    for (size_t i = 0; i < numThreads; i++)
-        workers.emplace_back(threadFunc);
-    for (auto& w : workers)
-        w.join();
-    workers.clear();
+    bool streamFailed = false;
+    if (continuous) {
+        std::filesystem::path outName;
+        if (benchmarkOnly) {
+            // nothing is written
+        } else if (!streamPath.empty()) {
+            const ConfigManager& cm = ConfigManager::Instance();
+            stream = std::make_unique<RawSink>(streamPath, streamFormat, cm.GetSampleRate(), cm.GetExportDither(), streamRealtime);
+            outName = streamPath;
+        } else {
+            std::string fname = playlistFile;
+            boost::replace_all(fname, "/", "_");
+            outName = dir / fname;
+            outName += fileExtension();
+            stream = openFile(outName, static_cast<int>(ConfigManager::Instance().GetSampleRate()));
+            if (!stream)
+                throw Xcept("Creating output file failed");
+        }
+        runThreads(1, [&]() {
+            OS::LowerThreadPriority();
+            totalBlocksRendered = exportPlaylist(entries, estimatedMicroframes, result, trackThreads);
+        });
+        for (SongExportResult& songResult : result.songs)
+            songResult.fileName = outName;
+        // the sink is closed by the writer once everything is written
+        if (stream)
+            writer->Close(std::move(stream), &streamFailed);
+    } else {
+        runThreads(songThreads, threadFunc);
+    }
+    writer.reset();     // waits for the remaining writes
+    size_t failedSongs = 0;
+    for (SongExportResult& songResult : result.songs) {
+        songResult.failed = songResult.failed || streamFailed;
+        if (songResult.failed)
+            failedSongs++;
+    }
+
+    // only complete files may be added to the cache, skip songs with a file that failed
+    if (cache) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            const SongExportResult& songResult = result.songs[i];
+            if (!songResult.cached && !songResult.failed && songResult.samplesRendered > 0 && !songResult.files.empty())
+                cache->Store(cacheKeys[i], songResult.fileName, songResult.files, songResult.samplesRendered);
+        }
+    }
 
     auto endTime = std::chrono::high_resolution_clock::now();
 
     /* report finished progress */
-    if (std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count() == 0) {
-        Debug::print("Successfully wrote %zu files", entries.size());
+    if (failedSongs > 0) {
+        Debug::print("Error: %zu of %zu songs couldn't be written completely", failedSongs, entries.size());
+    } else if (std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count() == 0) {
+        Debug::print("Successfully wrote %zu %s", entries.size(), continuous ? "songs" : "files");
     } else {
         size_t secondsTotal = static_cast<size_t>(std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count());
         size_t blocksPerSecond = totalBlocksRendered / secondsTotal;
-        Debug::print("Successfully wrote %zu files at %zu blocks per second (%zu seconds total)", entries.size(), blocksPerSecond, secondsTotal);
+        Debug::print("Successfully wrote %zu %s at %zu blocks per second (%zu seconds total)", entries.size(), continuous ? "songs" : "files", blocksPerSecond, secondsTotal);
     }
+
+    result.sampleRate = ConfigManager::Instance().GetSampleRate();
+    result.numThreads = numThreads;
+    result.seconds = std::chrono::duration<double>(endTime - startTime).count();
+    return result;
+}
+
+void SoundExporter::SetStream(const std::string& path, RawFormat format, bool realtime)
+{
+    streamPath = path;
+    streamFormat = format;
+    streamRealtime = realtime;
+}
+
+void SoundExporter::SetPlaylistFile(const std::string& name)
+{
+    playlistFile = name;
+}
+
+void SoundExporter::SetCrossfade(double seconds)
+{
+    crossfadeSeconds = std::max(seconds, 0.0);
+}
+
+void SoundExporter::SetDigest(bool enabled)
+{
+    computeDigest = enabled;
 }
 
 /*
  * private SoundExporter
  */
 
-void SoundExporter::writeSilence(SNDFILE *ofile, double seconds)
+void SoundExporter::runThreads(size_t numThreads, const std::function<void(void)>& func)
+{
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < numThreads; i++)
+        workers.emplace_back(func);
+    for (auto& w : workers)
+        w.join();
+}
+
+void SoundExporter::mixTracks(const std::vector<std::vector<sample>>& trackAudio, std::vector<sample>& out)
+{
+    for (const std::vector<sample>& b : trackAudio)
+    {
+        assert(b.size() >= out.size());
+        for (size_t i = 0; i < out.size(); i++) {
+            out[i].left  += b[i].left;
+            out[i].right += b[i].right;
+        }
+    }
+}
+
+/*
+ * Renders all songs in order into one sink (or nowhere in benchmark mode).
+ * Without a crossfade, every song is played until HasEnded(), including its
+ * own fade out, and the next one starts at its estimated end. With a
+ * crossfade, the next song starts crossfadeSeconds before the estimated end,
+ * but no later than the song's own fade out would begin. From there, the
+ * previous song fades out with an equal power curve while the next one fades
+ * in, so the combined level stays the same. The context of the next song is
+ * set up on another thread while the current one is rendered.
+ * Returns the total number of samples written.
+ */
+size_t SoundExporter::exportPlaylist(const std::vector<SongEntry>& entries, const std::vector<size_t>& lengths,
+        ExportResult& result, size_t trackThreads)
+{
+    const uint32_t sampleRate = ConfigManager::Instance().GetSampleRate();
+    const size_t fadeMicroframes = static_cast<size_t>(std::round(crossfadeSeconds * AGB_FPS * INTERFRAMES));
+    // render about one second per call to amortize the per microframe overhead
+    const size_t nMicroframes = AGB_FPS * INTERFRAMES;
+
+    std::unique_ptr<WorkerPool> trackPool;
+    if (trackThreads > 1)
+        trackPool = std::make_unique<WorkerPool>(trackThreads);
+
+    struct Playing {
+        size_t song;
+        std::unique_ptr<PlayerContext> ctx;
+        size_t microframesRendered = 0;
+        size_t fadeStart = 0;   // microframes before the song's own fade out
+        std::vector<std::vector<sample>> trackAudio;
+        std::vector<sample> mixed;
+    };
+
+    auto startSong = [&](size_t i) {
+        GameConfig& cfg = ConfigManager::Instance().GetCfg();
+        auto p = std::make_unique<Playing>();
+        p->song = i;
+        p->ctx = std::make_unique<PlayerContext>(
+                ConfigManager::Instance().GetMaxLoopsExport(),
+                cfg.GetTrackLimit(),
+                EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq()),
+                sampleRate
+                );
+        p->ctx->workerPool = trackPool.get();
+        const size_t songPos = songTable.GetPosOfSong(entries[i].GetUID());
+        p->fadeStart = lengths[i];
+        if (fadeMicroframes > 0 && i + 1 < entries.size()) {
+            p->ctx->InitSong(songPos);
+            p->ctx->EstimateMicroframes(lengths[i], &p->fadeStart);
+        }
+        p->ctx->InitSong(songPos);
+        return p;
+    };
+
+    /* overlap[i] is the crossfade between song i and i + 1, at most half of
+     * each song so that a song never overlaps with more than one other */
+    std::vector<size_t> overlap(entries.size(), 0);
+    for (size_t i = 0; i + 1 < entries.size(); i++)
+        overlap[i] = std::min({fadeMicroframes, lengths[i] / 2, lengths[i + 1] / 2});
+
+    // renders the next numMicroframes of a song and mixes them into out
+    auto renderSong = [&](Playing& p, size_t numMicroframes, std::vector<sample>& out) {
+        auto songStartTime = std::chrono::steady_clock::now();
+        size_t n = p.ctx->Render(p.trackAudio, numMicroframes);
+        if (out.size() < n)
+            out.resize(n, sample{0.0f, 0.0f});
+        p.mixed.assign(n, sample{0.0f, 0.0f});
+        mixTracks(p.trackAudio, p.mixed);
+        for (size_t i = 0; i < n; i++) {
+            out[i].left += p.mixed[i].left;
+            out[i].right += p.mixed[i].right;
+        }
+        p.microframesRendered += numMicroframes;
+        auto songEndTime = std::chrono::steady_clock::now();
+
+        SongExportResult& songResult = result.songs[p.song];
+        songResult.samplesRendered += n;
+        songResult.seconds += std::chrono::duration<double>(songEndTime - songStartTime).count();
+    };
+
+    auto songDone = [&](const Playing& p) {
+        const SongExportResult& songResult = result.songs[p.song];
+        Debug::print("Rendered \"%s\" (%.1f s of audio) in %.2f s", songResult.name.c_str(),
+                double(songResult.samplesRendered) / sampleRate, songResult.seconds);
+    };
+
+    size_t samplesWritten = 0;
+    auto write = [&](std::vector<sample>&& data) {
+        samplesWritten += data.size();
+        if (stream)
+            writer->Write(stream.get(), std::move(data));
+    };
+    auto getBuffer = [&]() {
+        return writer ? writer->GetBuffer() : std::vector<sample>();
+    };
+
+    if (stream)
+        writeSilence(stream.get(), ConfigManager::Instance().GetPadSecondsStart(), sampleRate);
+
+    std::unique_ptr<Playing> cur, prev;
+    std::future<std::unique_ptr<Playing>> next = std::async(std::launch::async, startSong, 0);
+    for (size_t i = 0; i < entries.size(); i++) {
+        SongExportResult& songResult = result.songs[i];
+        songResult.uid = entries[i].GetUID();
+        songResult.name = entries[i].name;
+        Debug::print("%3d %% - Rendering: \"%s\"", int((i + 1) * 100 / entries.size()), entries[i].name.c_str());
+
+        cur = next.get();
+        if (i + 1 < entries.size())
+            next = std::async(std::launch::async, startSong, i + 1);
+
+        /* continue with the end of the previous song, both songs have to
+         * use the same sample clock so that their blocks line up */
+        if (prev) {
+            cur->ctx->mixer.AlignSampleClock(prev->ctx->mixer);
+            if (overlap[i - 1] > 0 && !prev->ctx->HasEnded()) {
+                const float millis = float(overlap[i - 1] * 1000 + 500) / float(AGB_FPS * INTERFRAMES);
+                prev->ctx->mixer.StartCrossfadeOut(millis);
+                cur->ctx->mixer.StartCrossfadeIn(millis);
+                // the previous song is silent after its fade, whether it has ended or not
+                while (!prev->ctx->mixer.IsFadeDone()) {
+                    const size_t run = std::min(nMicroframes, prev->ctx->mixer.GetFadeMicroframesLeft());
+                    std::vector<sample> block = getBuffer();
+                    block.clear();
+                    renderSong(*prev, run, block);
+                    // a short song may end while the previous one is still playing
+                    if (!cur->ctx->HasEnded())
+                        renderSong(*cur, run, block);
+                    write(std::move(block));
+                }
+            } else {
+                // a song which is longer than estimated plays on below the next one
+                while (!prev->ctx->HasEnded()) {
+                    std::vector<sample> block = getBuffer();
+                    block.clear();
+                    renderSong(*prev, nMicroframes, block);
+                    if (!cur->ctx->HasEnded())
+                        renderSong(*cur, nMicroframes, block);
+                    write(std::move(block));
+                }
+            }
+            songDone(*prev);
+            prev.reset();
+        }
+
+        /* play the song alone until the next one starts, the last one until it ends */
+        const bool last = i + 1 == entries.size();
+        size_t alone = lengths[i] - overlap[i];
+        if (overlap[i] > 0)
+            alone = std::min(alone, cur->fadeStart);
+        while (!cur->ctx->HasEnded() && (last || cur->microframesRendered < alone)) {
+            const size_t run = last ? nMicroframes : std::min(nMicroframes, alone - cur->microframesRendered);
+            std::vector<sample> block = getBuffer();
+            block.clear();
+            renderSong(*cur, run, block);
+            write(std::move(block));
+        }
+        prev = std::move(cur);
+    }
+
+    if (prev)
+        songDone(*prev);
+
+    if (stream)
+        writeSilence(stream.get(), ConfigManager::Instance().GetPadSecondsEnd(), sampleRate);
+    return samplesWritten;
+}
+
+SF_INFO SoundExporter::fileInfo(int sampleRate)
+{
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    info.samplerate = sampleRate;
+    info.channels = 2; // stereo
+    switch (ConfigManager::Instance().GetExportFormat()) {
+    case ExportFormat::WAV_FLOAT: info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT; break;
+    case ExportFormat::WAV_24: info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24; break;
+    case ExportFormat::WAV_16: info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16; break;
+    case ExportFormat::FLAC_24: info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24; break;
+    case ExportFormat::FLAC_16: info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16; break;
+    case ExportFormat::VORBIS: info.format = SF_FORMAT_OGG | SF_FORMAT_VORBIS; break;
+    case ExportFormat::OPUS: info.format = SF_FORMAT_OGG | SF_FORMAT_OPUS; break;
+    }
+    return info;
+}
+
+unsigned SoundExporter::intBits(ExportFormat format)
+{
+    switch (format) {
+    case ExportFormat::WAV_24:
+    case ExportFormat::FLAC_24:
+        return 24;
+    case ExportFormat::WAV_16:
+    case ExportFormat::FLAC_16:
+        return 16;
+    default:
+        // float and lossy formats are encoded from float samples
+        return 0;
+    }
+}
+
+const char *SoundExporter::fileExtension()
+{
+    switch (ConfigManager::Instance().GetExportFormat()) {
+    case ExportFormat::FLAC_24:
+    case ExportFormat::FLAC_16:
+        return ".flac";
+    case ExportFormat::VORBIS:
+        return ".ogg";
+    case ExportFormat::OPUS:
+        return ".opus";
+    default:
+        return ".wav";
+    }
+}
+
+std::unique_ptr<ExportSink> SoundExporter::openFile(const std::filesystem::path& path, int sampleRate)
+{
+    const ConfigManager& cm = ConfigManager::Instance();
+
+    /* exports from older versions may be hard linked to the render cache,
+     * remove them instead of overwriting the cached file */
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+
+    SF_INFO info = fileInfo(sampleRate);
+    SNDFILE *file = sf_open(path.string().c_str(), SFM_WRITE, &info);
+    if (file == NULL) {
+        Debug::print("Error: %s", sf_strerror(NULL));
+        return nullptr;
+    }
+
+    /* libsndfile maps all quality settings to 0..1, for FLAC higher values
+     * compress better, for Vorbis and Opus higher values sound better */
+    double level;
+    switch (cm.GetExportFormat()) {
+    case ExportFormat::FLAC_24:
+    case ExportFormat::FLAC_16:
+        level = cm.GetFlacCompressionLevel() / 8.0;
+        sf_command(file, SFC_SET_COMPRESSION_LEVEL, &level, sizeof(level));
+        break;
+    case ExportFormat::VORBIS:
+        level = cm.GetVorbisQuality();
+        sf_command(file, SFC_SET_VBR_ENCODING_QUALITY, &level, sizeof(level));
+        break;
+    case ExportFormat::OPUS:
+        level = cm.GetOpusQuality();
+        sf_command(file, SFC_SET_VBR_ENCODING_QUALITY, &level, sizeof(level));
+        break;
+    default:
+        break;
+    }
+    // seeded by the file name, so each track gets its own dither noise independent of the thread count
+    return std::make_unique<SndfileSink>(file, intBits(cm.GetExportFormat()), cm.GetExportDither(),
+            Quantizer::MakeSeed(path.filename().string()));
+}
+
+void SoundExporter::writeSilence(ExportSink *ofile, double seconds, uint32_t sampleRate)
 {
     if (seconds <= 0.0)
         return;
-    size_t samples = static_cast<size_t>(std::round(STREAM_SAMPLERATE * seconds));
-    std::vector<sample> silence(samples, {0.0f, 0.0f});
-    sf_writef_float(ofile, reinterpret_cast<float *>(silence.data()), static_cast<sf_count_t>(silence.size()));
+    size_t samples = static_cast<size_t>(std::round(sampleRate * seconds));
+    std::vector<sample> silence = writer->GetBuffer();
+    silence.assign(samples, sample{0.0f, 0.0f});
+    writer->Write(ofile, std::move(silence));
 }
 
-size_t SoundExporter::exportSong(const std::filesystem::path& fileName, uint16_t uid)
+size_t SoundExporter::exportSong(const std::filesystem::path& fileName, uint16_t uid, size_t trackThreads,
+        SongExportResult& songResult)
 {
+    std::vector<std::filesystem::path>& files = songResult.files;
     // setup our generators
     GameConfig& cfg = ConfigManager::Instance().GetCfg();
 
-    
+    std::unique_ptr<WorkerPool> trackPool;
+    if (trackThreads > 1)
+        trackPool = std::make_unique<WorkerPool>(trackThreads);
+
     PlayerContext ctx(
             ConfigManager::Instance().GetMaxLoopsExport(),
             cfg.GetTrackLimit(),
-            EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq())
+            EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq()),
+            ConfigManager::Instance().GetSampleRate()
             );
+    ctx.workerPool = trackPool.get();
     ctx.InitSong(songTable.GetPosOfSong(uid));
     size_t blocksRendered = 0;
-    size_t nBlocks = ctx.mixer.GetSamplesPerBuffer();
+    // render about one second per call to amortize the per microframe overhead
+    const size_t nMicroframes = AGB_FPS * INTERFRAMES;
     size_t nTracks = ctx.seq.tracks.size();
     std::vector<std::vector<sample>> trackAudio;
     double padSecondsStart = ConfigManager::Instance().GetPadSecondsStart();
     double padSecondsEnd = ConfigManager::Instance().GetPadSecondsEnd();
+    const int sampleRate = static_cast<int>(ctx.mixer.GetSampleRate());
 
     if (!benchmarkOnly) 
     {
         /* save each track to a separate file */
         if (seperate)
         {
-            std::vector<SNDFILE *> ofiles(nTracks, nullptr);
-            std::vector<SF_INFO> oinfos(nTracks);
+            std::vector<std::unique_ptr<ExportSink>> ofiles(nTracks);
 
             for (size_t i = 0; i < nTracks; i++)
             {
-                memset(&oinfos[i], 0, sizeof(oinfos[i]));
-                oinfos[i].samplerate = STREAM_SAMPLERATE;
-                oinfos[i].channels = 2; // stereo
-                oinfos[i].format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
                 char outName[PATH_MAX];
-                snprintf(outName, sizeof(outName), "%s.%02zu.wav", fileName.c_str(), i);
-                ofiles[i] = sf_open(outName, SFM_WRITE, &oinfos[i]);
-                if (ofiles[i] == NULL)
-                    Debug::print("Error: %s", sf_strerror(NULL));
+                snprintf(outName, sizeof(outName), "%s.%02zu%s", fileName.c_str(), i, fileExtension());
+                ofiles[i] = openFile(outName, sampleRate);
+                if (ofiles[i])
+                    files.emplace_back(outName);
+                else
+                    songResult.failed = true;
             }
 
             while (true)
             {
-                ctx.reader.Process();
-                ctx.mixer.Process(trackAudio);
-                if (ctx.HasEnded())
-                    break;
+                size_t nBlocks = ctx.Render(trackAudio, nMicroframes);
 
                 assert(trackAudio.size() == nTracks);
 
@@ -150,77 +667,65 @@ size_t SoundExporter::exportSong(const std::filesystem::path& fileName, uint16_t
                     // do not write to invalid files
                     if (ofiles[i] == NULL)
                         continue;
-                    sf_count_t processed = 0;
-                    do {
-                        processed += sf_writef_float(ofiles[i], &trackAudio[i][processed].left, sf_count_t(nBlocks) - processed);
-                    } while (processed < sf_count_t(nBlocks));
+                    // hand the rendered buffer to the writer and render into a recycled one
+                    std::vector<sample> block = writer->GetBuffer();
+                    std::swap(block, trackAudio[i]);
+                    block.resize(nBlocks);
+                    writer->Write(ofiles[i].get(), std::move(block));
                 }
                 blocksRendered += nBlocks;
+                if (ctx.HasEnded())
+                    break;
             }
 
-            for (SNDFILE *& i : ofiles)
+            for (std::unique_ptr<ExportSink>& i : ofiles)
             {
-                int err = sf_close(i);
-                if (err != 0)
-                    Debug::print("Error: %s", sf_error_number(err));
+                if (i)
+                    writer->Close(std::move(i), &songResult.failed);
             }
         }
         else
         {
-            SF_INFO oinfo;
-            memset(&oinfo, 0, sizeof(oinfo));
-            oinfo.samplerate = STREAM_SAMPLERATE;
-            oinfo.channels = 2; // sterep
-            oinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
-            SNDFILE *ofile = sf_open((fileName.string() + ".wav").c_str(), SFM_WRITE, &oinfo);
-            if (ofile == NULL) {
-                Debug::print("Error: %s", sf_strerror(NULL));
+            const std::filesystem::path outName = fileName.string() + fileExtension();
+            std::unique_ptr<ExportSink> songFile = openFile(outName, sampleRate);
+            if (!songFile) {
+                songResult.failed = true;
                 return 0;
             }
+            files.emplace_back(outName);
+            ExportSink *ofile = songFile.get();
             // do rendering and write
-            std::vector<sample> renderedData(nBlocks);
-
-            writeSilence(ofile, padSecondsStart);
+            writeSilence(ofile, padSecondsStart, ctx.mixer.GetSampleRate());
 
             while (true) 
             {
-                ctx.reader.Process();
-                ctx.mixer.Process(trackAudio);
-                if (ctx.HasEnded())
-                    break;
+                size_t nBlocks = ctx.Render(trackAudio, nMicroframes);
                 // mix streams to one master
                 assert(trackAudio.size() == nTracks);
-                // clear mixing buffer
-                fill(renderedData.begin(), renderedData.end(), sample{0.0f, 0.0f});
-                // mix all tracks to buffer
-                for (std::vector<sample>& b : trackAudio)
-                {
-                    assert(b.size() == renderedData.size());
-                    for (size_t i = 0; i < b.size(); i++) {
-                        renderedData[i].left  += b[i].left;
-                        renderedData[i].right += b[i].right;
-                    }
-                }
-                sf_count_t processed = 0;
-                do {
-                    processed += sf_writef_float(ofile, &renderedData[processed].left, sf_count_t(nBlocks) - processed);
-                } while (processed < sf_count_t(nBlocks));
+                std::vector<sample> renderedData = writer->GetBuffer();
+                renderedData.assign(nBlocks, sample{0.0f, 0.0f});
+                mixTracks(trackAudio, renderedData);
+                writer->Write(ofile, std::move(renderedData));
                 blocksRendered += nBlocks;
+                if (ctx.HasEnded())
+                    break;
             }
 
-            writeSilence(ofile, padSecondsEnd);
-
-            int err;
-            if ((err = sf_close(ofile)) != 0)
-                Debug::print("Error: %s", sf_error_number(err));
+            writeSilence(ofile, padSecondsEnd, ctx.mixer.GetSampleRate());
+            writer->Close(std::move(songFile), &songResult.failed);
         }
     } 
     // if benchmark only
     else {
+        std::vector<sample> renderedData;
         while (true)
         {
-            ctx.reader.Process();
-            ctx.mixer.Process(trackAudio);
+            size_t nBlocks = ctx.Render(trackAudio, nMicroframes);
+            if (computeDigest) {
+                renderedData.assign(nBlocks, sample{0.0f, 0.0f});
+                mixTracks(trackAudio, renderedData);
+                songResult.digest.Add(renderedData);
+            }
             blocksRendered += nBlocks;
             if (ctx.HasEnded())
                 break;
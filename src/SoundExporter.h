@@ -5,25 +5,96 @@
 #include <vector>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <functional>
 
 #include "SongEntry.h"
 #include "GameConfig.h"
 #include "ConsoleGUI.h"
 #include "SoundData.h"
+#include "ExportWriter.h"
+#include "ExportSink.h"
+
+/*
+ * Hash and level of rendered audio, used to check that changes to the engine
+ * don't change the output. The hash covers the exact float samples, so it is
+ * only comparable between builds for the same platform and compiler flags.
+ */
+struct AudioDigest
+{
+    void Add(const std::vector<sample>& data);
+    double GetRmsDb() const;
+    double GetPeakDb() const;
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    size_t samples = 0;
+    double sumSquares = 0.0;
+    float peak = 0.0f;
+};
+
+struct SongExportResult
+{
+    uint16_t uid = 0;
+    std::string name;
+    std::filesystem::path fileName;
+    std::vector<std::filesystem::path> files;   // all files written for this song
+    bool cached = false;                        // restored from the render cache
+    bool failed = false;                        // a file couldn't be written completely
+    size_t samplesRendered = 0;
+    double estimatedSeconds = 0.0;  // song length estimated before rendering
+    double seconds = 0.0;           // time taken to render the song
+    AudioDigest digest;             // only with SetDigest() in benchmark mode
+};
+
+struct ExportResult
+{
+    std::vector<SongExportResult> songs;    // same order as the exported entries
+    uint32_t sampleRate = 0;
+    size_t numThreads = 0;
+    double seconds = 0.0;
+};
 
 class SoundExporter
 {
 public:
-    SoundExporter(SongTable& songTable, bool benchmarkOnly, bool seperate);
+    // numThreads == 0 uses one thread per CPU
+    SoundExporter(SongTable& songTable, const std::filesystem::path& outputDir, bool benchmarkOnly, bool seperate, size_t numThreads);
     SoundExporter(const SoundExporter&) = delete;
     SoundExporter& operator=(const SoundExporter&) = delete;
 
-    void Export(const std::vector<SongEntry>& entries);
+    // instead of files, write all songs mixed to a raw PCM stream ("-" for stdout)
+    void SetStream(const std::string& path, RawFormat format, bool realtime);
+    // instead of one file per song, write all songs mixed to one file in the output directory
+    void SetPlaylistFile(const std::string& name);
+    // overlap of consecutive songs when writing to a stream or playlist file
+    void SetCrossfade(double seconds);
+    // in benchmark mode, compute an AudioDigest of each song's mixed output
+    void SetDigest(bool enabled);
+    ExportResult Export(const std::vector<SongEntry>& entries);
 private:
-    static void writeSilence(SNDFILE *ofile, double seconds);
-    size_t exportSong(const std::filesystem::path& fileName, uint16_t uid);
+    static void runThreads(size_t numThreads, const std::function<void(void)>& func);
+    static SF_INFO fileInfo(int sampleRate);
+    static unsigned intBits(ExportFormat format);
+    static const char *fileExtension();
+    std::unique_ptr<ExportSink> openFile(const std::filesystem::path& path, int sampleRate);
+    static void mixTracks(const std::vector<std::vector<sample>>& trackAudio, std::vector<sample>& out);
+    size_t exportPlaylist(const std::vector<SongEntry>& entries, const std::vector<size_t>& lengths,
+            ExportResult& result, size_t trackThreads);
+    void writeSilence(ExportSink *ofile, double seconds, uint32_t sampleRate);
+    size_t exportSong(const std::filesystem::path& fileName, uint16_t uid, size_t trackThreads,
+            SongExportResult& songResult);
 
     SongTable& songTable;
+    std::filesystem::path outputDir;
+    size_t numThreads;
+    std::string streamPath;     // empty: write files
+    RawFormat streamFormat = RawFormat::F32;
+    bool streamRealtime = false;
+    std::string playlistFile;   // empty: one file per song
+    double crossfadeSeconds = 0.0;
+    bool computeDigest = false;
+    std::unique_ptr<ExportSink> stream;     // must outlive the writer
+    std::unique_ptr<ExportWriter> writer;
 
     bool benchmarkOnly;
     bool seperate; // seperate tracks to multiple files
@@ -3,6 +3,7 @@
 #include <cassert>
 
 #include "SoundMixer.h"
+#include "Profiler.h"
 #include "Xcept.h"
 #include "Debug.h"
 #include "Util.h"
@@ -21,7 +22,7 @@ SoundMixer::SoundMixer(PlayerContext& ctx, uint32_t sampleRate, float masterVolu
 void SoundMixer::Init(uint32_t fixedModeRate, uint8_t reverb, float pcmMasterVolume, ReverbType rtype, uint8_t numTracks)
 {
     this->fixedModeRate = fixedModeRate;
-    this->samplesPerBuffer = sampleRate / (AGB_FPS * INTERFRAMES);
+    this->sampleAccu = 0;
     this->numTracks = numTracks;
     this->pcmMasterVolume = pcmMasterVolume;
 
@@ -66,95 +67,85 @@ void SoundMixer::Init(uint32_t fixedModeRate, uint8_t reverb, float pcmMasterVol
 
 void SoundMixer::Process(std::vector<std::vector<sample>>& outputBuffers)
 {
-    /* 1. match number of output buffers to the number of tracks we have */
-    if (outputBuffers.size() != numTracks) {
-        outputBuffers.resize(numTracks, std::vector<sample>(samplesPerBuffer));
-    }
+    /* match number of output buffers to the number of tracks we have */
+    const size_t numSamples = GetSamplesForMicroframes(1);
+    outputBuffers.resize(numTracks);
+    for (auto& outputBuffer : outputBuffers)
+        outputBuffer.resize(numSamples);
+
+    Process(outputBuffers, 0, 1);
+}
 
-    /* 2. clear the mixing buffer before processing channels */
-    for (auto& outputBuffer : outputBuffers) {
-        assert(outputBuffer.size() == samplesPerBuffer);
-        std::fill(outputBuffer.begin(), outputBuffer.end(), sample{0.0f, 0.0f});
+/*
+ * Mixes numMicroframes microframes starting at sample offset of each output buffer.
+ * No sequencer tick may happen during these microframes.
+ */
+void SoundMixer::Process(std::vector<std::vector<sample>>& outputBuffers, size_t offset, size_t numMicroframes)
+{
+    const uint32_t microframeRate = AGB_FPS * INTERFRAMES;
+    microframeSamples.resize(numMicroframes);
+    size_t numSamples = 0;
+    for (size_t j = 0; j < numMicroframes; j++) {
+        sampleAccu += sampleRate;
+        microframeSamples[j] = sampleAccu / microframeRate;
+        sampleAccu %= microframeRate;
+        numSamples += microframeSamples[j];
     }
 
-    /* 3. prepare arguments for mixing */
+    /* 1. prepare arguments for mixing */
+    assert(outputBuffers.size() == numTracks);
+    assert(revdsps.size() == numTracks);
     MixingArgs margs;
     margs.vol = pcmMasterVolume;
     margs.fixedModeRate = fixedModeRate;
     margs.sampleRateInv = 1.0f / static_cast<float>(sampleRate);
-    margs.samplesPerBufferInv= 1.0f / static_cast<float>(samplesPerBuffer);
     margs.curInterFrame = ctx.GetCurInterFrame();
 
-    /* 4. mix channels which are affected by reverb (PCM only) */
-    for (auto& chn : ctx.sndChannels) {
-        assert(chn.GetTrackIdx() < numTracks);
-        chn.Process(outputBuffers[chn.GetTrackIdx()].data(), samplesPerBuffer, margs);
+    /* 2. advance the fade, the levels are applied per track */
+    fadeLevels.resize(numMicroframes);
+    for (size_t j = 0; j < numMicroframes; j++) {
+        float masterFrom = masterVolume;
+        float masterTo = masterVolume;
+        if (fadeMicroframesLeft > 0) {
+            masterFrom *= getFadeLevel(fadePos);
+            fadePos += fadeStepPerMicroframe;
+            masterTo *= getFadeLevel(fadePos);
+            fadeMicroframesLeft--;
+        }
+        fadeLevels[j] = {masterFrom, masterTo};
     }
 
-    /* 5. apply reverb */
-    assert(revdsps.size() == numTracks);
-    for (size_t i = 0; i < outputBuffers.size(); i++)
-        revdsps[i]->ProcessData(outputBuffers[i].data(), samplesPerBuffer);
-
-    /* 6. mix channels which are not affected by reverb (CGB) */
-    for (auto& chn : ctx.sq1Channels) {
-        assert(chn.GetTrackIdx() < numTracks);
-        chn.Process(outputBuffers[chn.GetTrackIdx()].data(), samplesPerBuffer, margs);
-    }
-    for (auto& chn : ctx.sq2Channels) {
-        assert(chn.GetTrackIdx() < numTracks);
-        chn.Process(outputBuffers[chn.GetTrackIdx()].data(), samplesPerBuffer, margs);
-    }
-    for (auto& chn : ctx.waveChannels) {
-        assert(chn.GetTrackIdx() < numTracks);
-        chn.Process(outputBuffers[chn.GetTrackIdx()].data(), samplesPerBuffer, margs);
-    }
-    for (auto& chn : ctx.noiseChannels) {
-        assert(chn.GetTrackIdx() < numTracks);
-        chn.Process(outputBuffers[chn.GetTrackIdx()].data(), samplesPerBuffer, margs);
+    /* 3. mix the tracks, they don't share any state so they may run in parallel */
+    struct {
+        std::vector<std::vector<sample>>& outputBuffers;
+        size_t offset;
+        size_t numMicroframes;
+        size_t numSamples;
+        const MixingArgs& margs;
+    } run{outputBuffers, offset, numMicroframes, numSamples, margs};
+    auto mixTrackTask = [this, &run](size_t trackIdx) {
+        assert(run.outputBuffers[trackIdx].size() >= run.offset + run.numSamples);
+        mixTrack(static_cast<uint8_t>(trackIdx), run.outputBuffers[trackIdx].data() + run.offset,
+                run.numMicroframes, run.numSamples, run.margs);
+    };
+    if (ctx.workerPool) {
+        ctx.workerPool->ParallelFor(numTracks, mixTrackTask);
+    } else {
+        for (size_t i = 0; i < numTracks; i++)
+            mixTrackTask(i);
     }
 
-    /* 7. clean up all stopped channels */
+    /* 4. clean up all stopped channels */
     ctx.sndChannels.remove_if([](const auto& chn) { return chn.GetState() == EnvState::DEAD; });
     ctx.sq1Channels.remove_if([](const auto& chn) { return chn.GetState() == EnvState::DEAD; });
     ctx.sq2Channels.remove_if([](const auto& chn) { return chn.GetState() == EnvState::DEAD; });
     ctx.waveChannels.remove_if([](const auto& chn) { return chn.GetState() == EnvState::DEAD; });
     ctx.noiseChannels.remove_if([](const auto& chn) { return chn.GetState() == EnvState::DEAD; });
-
-    /* 8. apply fadeout if active */
-    float masterFrom = masterVolume;
-    float masterTo = masterVolume;
-    if (fadeMicroframesLeft > 0) {
-        if (fadePos < 0.f) {
-            masterFrom = 0.f;
-        } else {
-            masterFrom *= powf(fadePos, 10.0f / 6.0f);
-        }
-        fadePos += fadeStepPerMicroframe;
-        if (fadePos < 0.f) {
-            masterTo = 0.f;
-        } else {
-            masterTo *= powf(fadePos, 10.0f / 6.0f);
-        }
-        fadeMicroframesLeft--;
-    }
-
-    for (auto& outputBuffer : outputBuffers) {
-        float masterStep = (masterTo - masterFrom) * margs.samplesPerBufferInv;
-        float masterLevel = masterFrom;
-        for (size_t i = 0; i < samplesPerBuffer; i++)
-        {
-            outputBuffer[i].left *= masterLevel;
-            outputBuffer[i].right *= masterLevel;
-
-            masterLevel +=  masterStep;
-        }
-    }
 }
 
-size_t SoundMixer::GetSamplesPerBuffer() const
+size_t SoundMixer::GetSamplesForMicroframes(size_t numMicroframes) const
 {
-    return samplesPerBuffer;
+    return (sampleAccu + numMicroframes * sampleRate) / (AGB_FPS * INTERFRAMES);
 }
 
 uint32_t SoundMixer::GetSampleRate() const
@@ -166,13 +157,18 @@ void SoundMixer::ResetFade()
 {
     fadePos = 0.0f;
     fadeMicroframesLeft = 0;
+    equalPowerFade = false;
+    crossfadeOut = false;
 }
 
 void SoundMixer::StartFadeOut(float millis)
 {
+    if (crossfadeOut)
+        return;
     fadePos = 1.0f;
     fadeMicroframesLeft = size_t(millis / 1000.0f * float(AGB_FPS * INTERFRAMES));
     fadeStepPerMicroframe = -1.0f / float(fadeMicroframesLeft);
+    equalPowerFade = false;
 }
 
 void SoundMixer::StartFadeIn(float millis)
@@ -180,9 +176,110 @@ void SoundMixer::StartFadeIn(float millis)
     fadePos = 0.0f;
     fadeMicroframesLeft = size_t(millis / 1000.0f * float(AGB_FPS * INTERFRAMES));
     fadeStepPerMicroframe = 1.0f / float(fadeMicroframesLeft);
+    equalPowerFade = false;
+}
+
+void SoundMixer::StartCrossfadeOut(float millis)
+{
+    StartFadeOut(millis);
+    equalPowerFade = true;
+    crossfadeOut = true;
+}
+
+void SoundMixer::StartCrossfadeIn(float millis)
+{
+    StartFadeIn(millis);
+    equalPowerFade = true;
 }
 
 bool SoundMixer::IsFadeDone() const
 {
     return fadeMicroframesLeft == 0;
 }
+
+size_t SoundMixer::GetFadeMicroframesLeft() const
+{
+    return fadeMicroframesLeft;
+}
+
+void SoundMixer::AlignSampleClock(const SoundMixer& other)
+{
+    sampleAccu = other.sampleAccu;
+}
+
+/*
+ * private SoundMixer
+ */
+
+float SoundMixer::getFadeLevel(float pos) const
+{
+    if (pos <= 0.f)
+        return 0.f;
+    // sin² + cos² = 1, so two songs crossfading with this curve keep their summed power
+    if (equalPowerFade)
+        return sinf(std::min(pos, 1.0f) * float(M_PI) / 2.0f);
+    return powf(pos, 10.0f / 6.0f);
+}
+
+void SoundMixer::mixTrack(uint8_t trackIdx, sample *buffer, size_t numMicroframes, size_t numSamples, MixingArgs margs)
+{
+    /* 1. clear the mixing buffer before processing channels */
+    std::fill(buffer, buffer + numSamples, sample{0.0f, 0.0f});
+
+    /* 2. mix channels which are affected by reverb (PCM only), all microframes in one go */
+    for (auto& chn : ctx.sndChannels.InTrack(trackIdx))
+        chn.ProcessMicroframes(buffer, numMicroframes, microframeSamples.data(), margs);
+
+    /* 3. apply reverb, the GS reverbs expect to be fed one microframe at a time */
+    size_t microframeOffset = 0;
+    {
+        PROFILE_SCOPE(ProfileStage::REVERB);
+        for (size_t j = 0; j < numMicroframes; j++) {
+            revdsps[trackIdx]->ProcessData(buffer + microframeOffset, microframeSamples[j]);
+            microframeOffset += microframeSamples[j];
+        }
+    }
+
+    /* 4. mix channels which are not affected by reverb (CGB) */
+    {
+        PROFILE_SCOPE(ProfileStage::CGB);
+        microframeOffset = 0;
+        for (size_t j = 0; j < numMicroframes; j++) {
+            const size_t samplesPerBuffer = microframeSamples[j];
+            margs.samplesPerBufferInv = 1.0f / static_cast<float>(samplesPerBuffer);
+            margs.curInterFrame = ctx.GetCurInterFrame() + j;
+
+            for (auto& chn : ctx.sq1Channels.InTrack(trackIdx))
+                chn.Process(buffer + microframeOffset, samplesPerBuffer, margs);
+            for (auto& chn : ctx.sq2Channels.InTrack(trackIdx))
+                chn.Process(buffer + microframeOffset, samplesPerBuffer, margs);
+            for (auto& chn : ctx.waveChannels.InTrack(trackIdx))
+                chn.Process(buffer + microframeOffset, samplesPerBuffer, margs);
+            for (auto& chn : ctx.noiseChannels.InTrack(trackIdx))
+                chn.Process(buffer + microframeOffset, samplesPerBuffer, margs);
+            microframeOffset += samplesPerBuffer;
+        }
+    }
+
+    /* 5. apply fadeout */
+    PROFILE_SCOPE(ProfileStage::FADE);
+    microframeOffset = 0;
+    for (size_t j = 0; j < numMicroframes; j++) {
+        const size_t samplesPerBuffer = microframeSamples[j];
+        const float samplesPerBufferInv = 1.0f / static_cast<float>(samplesPerBuffer);
+        const float masterFrom = fadeLevels[j].first;
+        const float masterTo = fadeLevels[j].second;
+
+        float masterStep = (masterTo - masterFrom) * samplesPerBufferInv;
+        float masterLevel = masterFrom;
+        sample *microframe = buffer + microframeOffset;
+        for (size_t i = 0; i < samplesPerBuffer; i++)
+        {
+            microframe[i].left *= masterLevel;
+            microframe[i].right *= masterLevel;
+
+            masterLevel +=  masterStep;
+        }
+        microframeOffset += samplesPerBuffer;
+    }
+}
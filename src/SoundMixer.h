@@ -1,10 +1,10 @@
 #pragma once
 
 #include <vector>
-#include <list>
 #include <cstdint>
 #include <bitset>
 #include <memory>
+#include <utility>
 
 #include "ReverbEffect.h"
 #include "SoundChannel.h"
@@ -23,20 +23,37 @@ public:
     void Init(uint32_t fixedModeRate, uint8_t reverb, float pcmMasterVolume, ReverbType rtype, uint8_t numTracks);
 
     void Process(std::vector<std::vector<sample>>& outputBuffers);
-    size_t GetSamplesPerBuffer() const;
+    void Process(std::vector<std::vector<sample>>& outputBuffers, size_t offset, size_t numMicroframes);
+    size_t GetSamplesForMicroframes(size_t numMicroframes) const;
     uint32_t GetSampleRate() const;
     void ResetFade();
     void StartFadeOut(float millis);
     void StartFadeIn(float millis);
+    /* Equal power fades for crossfading two songs, the summed level stays
+     * constant. While the crossfade out runs, StartFadeOut is ignored so the
+     * song's own fade out doesn't replace it. */
+    void StartCrossfadeOut(float millis);
+    void StartCrossfadeIn(float millis);
     bool IsFadeDone() const;
+    size_t GetFadeMicroframesLeft() const;
+    // continue with the sample clock of another mixer, so blocks of both line up
+    void AlignSampleClock(const SoundMixer& other);
 
 private:
+    void mixTrack(uint8_t trackIdx, sample *buffer, size_t numMicroframes, size_t numSamples, MixingArgs margs);
+    float getFadeLevel(float pos) const;
+
     PlayerContext& ctx;
 
     std::vector<std::unique_ptr<ReverbEffect>> revdsps;
     uint32_t sampleRate;
     uint32_t fixedModeRate = 13379;
-    size_t samplesPerBuffer = sampleRate / (AGB_FPS * INTERFRAMES);
+    /* The output rate usually isn't a multiple of the microframe rate,
+     * so the microframe length varies by one sample. sampleAccu holds the
+     * fractional sample count in units of 1/(AGB_FPS * INTERFRAMES). */
+    uint32_t sampleAccu = 0;
+    std::vector<size_t> microframeSamples;
+    std::vector<std::pair<float, float>> fadeLevels;   // master volume at start/end of each microframe
 
     // volume control related stuff
 
@@ -45,6 +62,8 @@ private:
     float fadePos = 1.0f;
     float fadeStepPerMicroframe = 0.0f;
     size_t fadeMicroframesLeft = 0;
+    bool equalPowerFade = false;
+    bool crossfadeOut = false;
 
     uint8_t numTracks = 0;
 };
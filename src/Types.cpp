@@ -81,6 +81,44 @@ std::string cgbPoly2str(CGBPolyphony t) {
     return "mono-strict";
 }
 
+ExportFormat str2exportFmt(const std::string& str)
+{
+    if (str == "wav-float")
+        return ExportFormat::WAV_FLOAT;
+    else if (str == "wav-24")
+        return ExportFormat::WAV_24;
+    else if (str == "wav-16")
+        return ExportFormat::WAV_16;
+    else if (str == "flac-24")
+        return ExportFormat::FLAC_24;
+    else if (str == "flac-16")
+        return ExportFormat::FLAC_16;
+    else if (str == "vorbis")
+        return ExportFormat::VORBIS;
+    else if (str == "opus")
+        return ExportFormat::OPUS;
+    return ExportFormat::WAV_FLOAT;
+}
+
+std::string exportFmt2str(ExportFormat t)
+{
+    if (t == ExportFormat::WAV_FLOAT)
+        return "wav-float";
+    else if (t == ExportFormat::WAV_24)
+        return "wav-24";
+    else if (t == ExportFormat::WAV_16)
+        return "wav-16";
+    else if (t == ExportFormat::FLAC_24)
+        return "flac-24";
+    else if (t == ExportFormat::FLAC_16)
+        return "flac-16";
+    else if (t == ExportFormat::VORBIS)
+        return "vorbis";
+    else if (t == ExportFormat::OPUS)
+        return "opus";
+    return "wav-float";
+}
+
 /*
  * ADSR
  */
@@ -10,6 +10,7 @@ enum class NoisePatt : int { FINE = 0, ROUGH };
 enum class ReverbType { NORMAL, GS1, GS2, MGAT, TEST, NONE };
 enum class ResamplerType { NEAREST, LINEAR, SINC, BLEP, BLAMP };
 enum class CGBPolyphony { MONO_STRICT, MONO_SMOOTH, POLY };
+enum class ExportFormat { WAV_FLOAT, WAV_24, WAV_16, FLAC_24, FLAC_16, VORBIS, OPUS };
 
 ReverbType str2rev(const std::string& str);
 std::string rev2str(ReverbType t);
@@ -17,6 +18,8 @@ ResamplerType str2res(const std::string& str);
 std::string res2str(ResamplerType t);
 CGBPolyphony str2cgbPoly(const std::string& str);
 std::string cgbPoly2str(CGBPolyphony t);
+ExportFormat str2exportFmt(const std::string& str);
+std::string exportFmt2str(ExportFormat t);
 
 union CGBDef
 {
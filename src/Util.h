@@ -1,6 +1,9 @@
 #pragma once
 
 #include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -15,3 +18,35 @@ inline void CStrAppend(char *dest, size_t *index, const char *src)
     while ((ch = *copyChar++) != '\0')
         dest[(*index)++] = ch;
 }
+
+// 64 bit FNV-1a, pass the previous result as hash to continue hashing
+inline uint64_t Fnv1a64(const void *data, size_t size, uint64_t hash = 0xCBF29CE484222325ULL)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// little endian loads from unaligned memory, compile to a single load on x86 and ARM
+inline uint16_t LoadLE16(const uint8_t *p)
+{
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    return value;
+}
+
+inline uint32_t LoadLE32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
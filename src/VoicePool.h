@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * VoicePool stores voices in chunks of fixed size slots. Chunks are only
+ * allocated when all slots are in use and are kept until the pool is destroyed,
+ * so once a song has warmed up, starting and stopping notes doesn't allocate.
+ * Slot indices stay stable for the lifetime of a voice.
+ *
+ * Live voices are iterated in insertion order (this matters for the order in
+ * which voices are mixed and for CGB polyphony). The interface mimics the
+ * subset of std::list which is used by the player.
+ *
+ * Additionally, the voices of each track are indexed (T has to provide
+ * GetTrackIdx()), so that the sequencer only has to look at voices of the
+ * track it is processing.
+ */
+template<typename T>
+class VoicePool
+{
+public:
+    VoicePool() = default;
+    VoicePool(const VoicePool&) = delete;
+    VoicePool& operator=(const VoicePool&) = delete;
+    ~VoicePool()
+    {
+        clear();
+    }
+
+    template<typename P, typename V>
+    class Iterator
+    {
+    public:
+        Iterator(P *pool, std::vector<uint32_t>::const_iterator it) : pool(pool), it(it) {}
+        V& operator*() const { return *pool->slotPtr(*it); }
+        V *operator->() const { return pool->slotPtr(*it); }
+        Iterator& operator++() { ++it; return *this; }
+        bool operator==(const Iterator& rhs) const { return it == rhs.it; }
+        bool operator!=(const Iterator& rhs) const { return it != rhs.it; }
+    private:
+        P *pool;
+        std::vector<uint32_t>::const_iterator it;
+    };
+    typedef Iterator<VoicePool, T> iterator;
+    typedef Iterator<const VoicePool, const T> const_iterator;
+
+    iterator begin() { return iterator(this, order.cbegin()); }
+    iterator end() { return iterator(this, order.cend()); }
+    const_iterator begin() const { return const_iterator(this, order.cbegin()); }
+    const_iterator end() const { return const_iterator(this, order.cend()); }
+
+    class TrackRange
+    {
+    public:
+        TrackRange(VoicePool *pool, const std::vector<uint32_t>& slots) : pool(pool), slots(slots) {}
+        iterator begin() const { return iterator(pool, slots.cbegin()); }
+        iterator end() const { return iterator(pool, slots.cend()); }
+    private:
+        VoicePool *pool;
+        const std::vector<uint32_t>& slots;
+    };
+
+    // all voices of one track, in insertion order
+    TrackRange InTrack(uint8_t trackIdx)
+    {
+        static const std::vector<uint32_t> noSlots;
+        if (trackIdx >= trackOrder.size())
+            return TrackRange(this, noSlots);
+        return TrackRange(this, trackOrder[trackIdx]);
+    }
+
+    size_t size() const { return order.size(); }
+    bool empty() const { return order.empty(); }
+    T& front() { return *slotPtr(order.front()); }
+    const T& front() const { return *slotPtr(order.front()); }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        if (freeSlots.empty())
+            addChunk();
+        uint32_t slot = freeSlots.back();
+        // if the constructor throws, the slot simply stays in the free list
+        T *voice = new (rawSlotPtr(slot)) T(std::forward<Args>(args)...);
+        freeSlots.pop_back();
+        order.push_back(slot);
+        uint8_t trackIdx = voice->GetTrackIdx();
+        if (trackIdx >= trackOrder.size())
+            trackOrder.resize(trackIdx + 1u);
+        trackOrder[trackIdx].push_back(slot);
+        return *voice;
+    }
+
+    template<typename Predicate>
+    void remove_if(Predicate pred)
+    {
+        // the track index is rebuilt from the surviving voices, which keeps it in order
+        for (auto& slots : trackOrder)
+            slots.clear();
+
+        size_t w = 0;
+        for (size_t r = 0; r < order.size(); r++) {
+            uint32_t slot = order[r];
+            T *voice = slotPtr(slot);
+            if (pred(*voice)) {
+                voice->~T();
+                freeSlots.push_back(slot);
+            } else {
+                order[w++] = slot;
+                trackOrder[voice->GetTrackIdx()].push_back(slot);
+            }
+        }
+        order.resize(w);
+    }
+
+    void clear()
+    {
+        remove_if([](const T&) { return true; });
+    }
+
+private:
+    static const size_t CHUNK_SIZE = 16;
+
+    struct Chunk {
+        alignas(T) unsigned char data[CHUNK_SIZE * sizeof(T)];
+    };
+
+    void addChunk()
+    {
+        uint32_t firstSlot = static_cast<uint32_t>(chunks.size() * CHUNK_SIZE);
+        chunks.emplace_back(std::make_unique<Chunk>());
+        // reserve ahead so returning voices never reallocates
+        freeSlots.reserve(chunks.size() * CHUNK_SIZE);
+        order.reserve(chunks.size() * CHUNK_SIZE);
+        // push in reverse so that lower slots get used first
+        for (size_t i = CHUNK_SIZE; i-- > 0;)
+            freeSlots.push_back(firstSlot + static_cast<uint32_t>(i));
+    }
+
+    void *rawSlotPtr(uint32_t slot) const
+    {
+        return &chunks[slot / CHUNK_SIZE]->data[(slot % CHUNK_SIZE) * sizeof(T)];
+    }
+
+    T *slotPtr(uint32_t slot) const
+    {
+        return std::launder(reinterpret_cast<T *>(rawSlotPtr(slot)));
+    }
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint32_t> order;
+    std::vector<std::vector<uint32_t>> trackOrder;
+};
@@ -15,6 +15,8 @@
 #include "WindowGUI.h"
 #include "Util.h"
 #include "SoundExporter.h"
+#include "ScanCache.h"
+#include "OS.h"
 
 #define KEY_TAB 9
 
@@ -99,10 +101,14 @@ WindowGUI::WindowGUI(SongTable& songTable)
             );
     mplay->LoadSong(songTable.GetPosOfSong(0));
     trackUI->SetTitle(songUI->GetSong()->GetName());
+
+    estimateThread = std::thread(&WindowGUI::estimateSongLengths, this);
 }
 
 WindowGUI::~WindowGUI() 
 {
+    estimateQuit.store(true);
+    estimateThread.join();
     endwin();
 }
 
@@ -227,6 +233,7 @@ bool WindowGUI::Handle()
 
                 Debug::print("Exiting...");
                 ConfigManager::Instance().Save();
+                ScanCache::Instance().Save();
                 mplay->Stop();
                 return false;
         } // end key handling switch
@@ -246,6 +253,7 @@ bool WindowGUI::Handle()
         mplay->GetMasterVolLevels(lVol, rVol);
         meterUI->SetVol(lVol, rVol);
     }
+    publishSongLengths();
     conUI->Refresh();
     return true;
 }
@@ -554,6 +562,27 @@ void WindowGUI::songInfo()
             sinfo.reverb,
             sinfo.priority
     );
+
+    if (!mplay->IsPlaying())
+        return;
+
+    PlaybackStats::Snapshot stats = mplay->GetPlaybackStats();
+    std::string fill;
+    for (uint64_t count : stats.fillHistogram) {
+        fill += fill.empty() ? "" : "/";
+        fill += std::to_string(stats.callbacks ? count * 100 / stats.callbacks : 0);
+    }
+    Debug::print("Playback: callbacks=%llu underruns=%llu driver underflows=%llu overflows=%llu",
+            static_cast<unsigned long long>(stats.callbacks),
+            static_cast<unsigned long long>(stats.underruns),
+            static_cast<unsigned long long>(stats.outputUnderflows),
+            static_cast<unsigned long long>(stats.outputOverflows)
+    );
+    Debug::print("Playback: render min/avg/p99=%.0f/%.0f/%.0fus callback jitter avg/max=%.0f/%.0fus",
+            stats.renderMinUs, stats.renderAvgUs, stats.renderP99Us,
+            stats.jitterAvgUs, stats.jitterMaxUs
+    );
+    Debug::print("Playback: buffer fill histogram (0%%-100%%, in %% of callbacks): %s", fill.c_str());
 }
 
 void WindowGUI::enter()
@@ -740,7 +769,7 @@ void WindowGUI::exportLaunch(bool benchmarkOnly, bool separate)
     exportBusy.store(true);
 
     exportThread = std::make_unique<std::thread>([&](std::vector<SongEntry> tEntries, bool tBenchmarkOnly, bool tSeparate) {
-            SoundExporter se(songTable, tBenchmarkOnly, tSeparate);
+            SoundExporter se(songTable, ConfigManager::Instance().GetWavOutputDir(), tBenchmarkOnly, tSeparate, 0);
             se.Export(tEntries);
             exportBusy.store(false);
         },
@@ -750,6 +779,40 @@ void WindowGUI::exportLaunch(bool benchmarkOnly, bool separate)
     );
 }
 
+void WindowGUI::estimateSongLengths()
+{
+    /* Each estimate runs the sequencer over the whole song, which can take a
+     * while for long songs, so this is done off the GUI thread. Songs from
+     * the scan cache don't have to be estimated and come in fast. */
+    OS::LowerThreadPriority();
+    for (size_t i = 0; i < songTable.GetNumSongs() && !estimateQuit.load(); i++) {
+        const uint16_t uid = static_cast<uint16_t>(i);
+        double seconds = 0.0;
+        try {
+            const size_t microframes = ScanCache::Instance().GetSongMicroframes(songTable, uid);
+            seconds = double(microframes) / double(AGB_FPS * INTERFRAMES);
+        } catch (const std::exception& e) {
+            Debug::print("Estimating the length of song %zu failed: %s", i, e.what());
+        }
+        std::lock_guard<std::mutex> lock(estimateMtx);
+        estimatedLengths.push_back(seconds);
+    }
+    ScanCache::Instance().Save();
+}
+
+void WindowGUI::publishSongLengths()
+{
+    std::vector<double> lengths;
+    {
+        std::lock_guard<std::mutex> lock(estimateMtx);
+        if (estimatedLengths.size() == publishedLengths)
+            return;
+        lengths = estimatedLengths;
+    }
+    publishedLengths = lengths.size();
+    songUI->SetSongLengths(lengths);
+}
+
 bool WindowGUI::exportReady()
 {
     if (exportBusy.load()) {
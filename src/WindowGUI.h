@@ -59,6 +59,10 @@
 #include "ConfigManager.h"
 
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
 
 class WindowGUI 
 {
@@ -97,6 +101,9 @@ private:
 
     void exportLaunch(bool benchmarkOnly, bool separate);
     bool exportReady();
+    // runs on estimateThread, publishSongLengths() hands the results to songUI
+    void estimateSongLengths();
+    void publishSongLengths();
 
     // console GUI element
     std::unique_ptr<ConsoleGUI> conUI;
@@ -113,6 +120,11 @@ private:
     std::unique_ptr<PlayerInterface> mplay;
     std::unique_ptr<std::thread> exportThread;
     std::atomic<bool> exportBusy = false;
+    std::thread estimateThread;
+    std::atomic<bool> estimateQuit = false;
+    std::mutex estimateMtx;
+    std::vector<double> estimatedLengths;   // in seconds, by song index, filled in over time
+    size_t publishedLengths = 0;
 
     // ncurses windows
     WINDOW *containerWin;
@@ -0,0 +1,125 @@
+#include "WorkerPool.h"
+#include "OS.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#else
+#define CPU_RELAX() std::this_thread::yield()
+#endif
+
+// roughly 50 us on current CPUs
+#define WORKER_SPIN_COUNT 2000
+
+/*
+ * public WorkerPool
+ */
+
+WorkerPool::WorkerPool(size_t numThreads)
+{
+    for (size_t i = 1; i < numThreads; i++)
+        threads.emplace_back(&WorkerPool::worker, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    quit.store(true);
+    wakeSeq.fetch_add(1);
+    OS::FutexWakeAll(wakeSeq);
+    for (std::thread& t : threads)
+        t.join();
+}
+
+size_t WorkerPool::GetNumThreads() const
+{
+    return threads.size() + 1;
+}
+
+void WorkerPool::ParallelFor(size_t numTasks, const std::function<void(size_t)>& task)
+{
+    if (threads.empty() || numTasks <= 1) {
+        for (size_t i = 0; i < numTasks; i++)
+            task(i);
+        return;
+    }
+
+    const uint32_t generation = static_cast<uint32_t>(ticket.load(std::memory_order_relaxed) >> 32) + 1;
+    ticket.store((uint64_t(generation) << 32) | TICKET_CLOSED, std::memory_order_relaxed);
+    this->task.store(&task, std::memory_order_relaxed);
+    this->numTasks.store(numTasks, std::memory_order_relaxed);
+    doneTasks.store(0, std::memory_order_relaxed);
+    // seq_cst pairs with sleeping.fetch_add() and the recheck in worker(): either
+    // we see the sleeper or it sees the new batch
+    ticket.store(uint64_t(generation) << 32, std::memory_order_seq_cst);
+
+    if (sleeping.load() > 0) {
+        wakeSeq.fetch_add(1);
+        OS::FutexWakeAll(wakeSeq);
+    }
+
+    runTasks(generation);
+    while (doneTasks.load(std::memory_order_acquire) < numTasks)
+        CPU_RELAX();
+}
+
+/*
+ * private WorkerPool
+ */
+
+void WorkerPool::worker()
+{
+    uint32_t lastGeneration = openGeneration();
+    while (true) {
+        uint32_t generation = openGeneration();
+        for (size_t spin = 0; spin < WORKER_SPIN_COUNT && generation == lastGeneration; spin++) {
+            CPU_RELAX();
+            generation = openGeneration();
+        }
+
+        if (generation == lastGeneration) {
+            const uint32_t seq = wakeSeq.load();
+            sleeping.fetch_add(1);
+            // recheck after announcing that we sleep, ParallelFor may have missed us
+            if (openGeneration(std::memory_order_seq_cst) == lastGeneration && !quit.load())
+                OS::FutexWait(wakeSeq, seq);
+            sleeping.fetch_sub(1);
+        }
+
+        if (quit.load())
+            return;
+
+        generation = openGeneration();
+        if (generation != lastGeneration) {
+            runTasks(generation);
+            lastGeneration = generation;
+        }
+    }
+}
+
+void WorkerPool::runTasks(uint32_t generation)
+{
+    uint64_t cur = ticket.load(std::memory_order_acquire);
+    while (true) {
+        if (static_cast<uint32_t>(cur >> 32) != generation)
+            break;
+        const size_t index = static_cast<size_t>(cur & TICKET_CLOSED);
+        if (index >= numTasks.load(std::memory_order_relaxed))
+            break;
+        if (!ticket.compare_exchange_weak(cur, cur + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            continue;
+
+        (*task.load(std::memory_order_relaxed))(index);
+        doneTasks.fetch_add(1, std::memory_order_release);
+        cur = ticket.load(std::memory_order_acquire);
+    }
+}
+
+// generation of the last batch that has been set up completely
+uint32_t WorkerPool::openGeneration(std::memory_order order) const
+{
+    const uint64_t cur = ticket.load(order);
+    uint32_t generation = static_cast<uint32_t>(cur >> 32);
+    if ((cur & TICKET_CLOSED) == TICKET_CLOSED)
+        generation--;
+    return generation;
+}
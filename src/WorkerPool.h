@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Small fork/join pool for running many short tasks, e.g. mixing the tracks
+ * of a song in parallel after each sequencer tick. The calling thread works
+ * on the tasks as well. Idle workers spin for a short while before they go
+ * to sleep, since the next batch usually follows within microseconds.
+ */
+class WorkerPool
+{
+public:
+    // numThreads includes the thread calling ParallelFor
+    WorkerPool(size_t numThreads);
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+    size_t GetNumThreads() const;
+    // runs task(0) .. task(numTasks - 1) and returns when all of them are done
+    void ParallelFor(size_t numTasks, const std::function<void(size_t)>& task);
+private:
+    void worker();
+    void runTasks(uint32_t generation);
+    uint32_t openGeneration(std::memory_order order = std::memory_order_acquire) const;
+
+    std::vector<std::thread> threads;
+
+    /* upper 32 bits: generation of the current batch, lower 32 bits: next task index.
+     * Claiming a task with CAS makes sure that a late worker can't claim a task
+     * of a newer batch with the state of an old one. While a batch is being set
+     * up, the index is TICKET_CLOSED. */
+    static const uint64_t TICKET_CLOSED = 0xFFFFFFFFu;
+    std::atomic<uint64_t> ticket{TICKET_CLOSED};
+    std::atomic<const std::function<void(size_t)> *> task{nullptr};
+    std::atomic<size_t> numTasks{0};
+    std::atomic<size_t> doneTasks{0};
+
+    std::atomic<uint32_t> wakeSeq{0};
+    std::atomic<size_t> sleeping{0};
+    std::atomic<bool> quit{false};
+};
@@ -4,37 +4,83 @@
 #include <curses.h>
 #include <portaudio.h>
 #include <clocale>
+#include <memory>
 
 #include "SoundData.h"
+#include "ScanCache.h"
 #include "Debug.h"
 #include "WindowGUI.h"
 #include "Xcept.h"
 #include "ConfigManager.h"
 #include "OS.h"
+#include "Constants.h"
+#include "ExportCLI.h"
 
 static void usage();
 static void help();
 
 int main(int argc, char *argv[])
 {
+    if (ExportCLI::IsRequested(argc, argv)) {
+        std::unique_ptr<ExportCLI> cli;
+        try {
+            cli = std::make_unique<ExportCLI>(argc, argv);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            ExportCLI::Usage();
+            return EXIT_FAILURE;
+        }
+        try {
+            return cli->Run();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
     OS::CheckTerminal();
 
     if (!Debug::open(nullptr)) {
         std::cout << "Debug Init failed" << std::endl;
         return EXIT_FAILURE;
     }
-    if (argc != 2 && argc != 3) {
+    const char *romPath = nullptr;
+    const char *songTableArg = nullptr;
+    unsigned long sampleRate = 0;
+    unsigned long bufferSize = 0;
+    try {
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp("--help", argv[i])) {
+                help();
+                return EXIT_SUCCESS;
+            } else if (!strcmp("--samplerate", argv[i]) && i + 1 < argc) {
+                sampleRate = std::stoul(argv[++i]);
+                if (sampleRate < STREAM_SAMPLERATE_MIN || sampleRate > STREAM_SAMPLERATE_MAX)
+                    throw std::out_of_range("samplerate");
+            } else if (!strcmp("--buffer-size", argv[i]) && i + 1 < argc) {
+                bufferSize = std::stoul(argv[++i]);
+                if (bufferSize < STREAM_BUF_SIZE_MIN || bufferSize > STREAM_BUF_SIZE_MAX)
+                    throw std::out_of_range("buffer-size");
+            } else if (romPath == nullptr) {
+                romPath = argv[i];
+            } else if (songTableArg == nullptr) {
+                songTableArg = argv[i];
+            } else {
+                throw std::invalid_argument(argv[i]);
+            }
+        }
+    } catch (std::exception& e) {
         usage();
         return EXIT_FAILURE;
     }
-    if (!strcmp("--help", argv[1])) {
-        help();
-        return EXIT_SUCCESS;
+    if (romPath == nullptr) {
+        usage();
+        return EXIT_FAILURE;
     }
     unsigned long songTableIndex = 0;
-    if (argc == 3) {
+    if (songTableArg != nullptr) {
       try {
-        songTableIndex = std::stoul(argv[2]);
+        songTableIndex = std::stoul(songTableArg);
       } catch (std::exception& e) {
         usage();
         return EXIT_FAILURE;
@@ -46,11 +92,20 @@ int main(int argc, char *argv[])
             throw Xcept("Couldn't init portaudio");
         std::cout << "Loading ROM..." << std::endl;
 
-        Rom::CreateInstance(argv[1]);
+        Rom::CreateInstance(romPath);
         std::cout << "Loading Config..." << std::endl;
         ConfigManager::Instance().Load();
+        if (sampleRate != 0)
+            ConfigManager::Instance().OverrideSampleRate(static_cast<uint32_t>(sampleRate));
+        if (bufferSize != 0) {
+            const uint32_t rate = ConfigManager::Instance().GetSampleRate();
+            const size_t minSize = ConfigManager::GetMinPlaybackBufferSize(rate);
+            if (bufferSize < minSize)
+                throw Xcept("Buffer size %lu is too small for %u Hz, use at least %zu", bufferSize, rate, minSize);
+            ConfigManager::Instance().OverridePlaybackBufferSize(bufferSize);
+        }
         std::cout << "Reading Songtable" << std::endl;
-        std::vector<SongTable> songTables = SongTable::ScanForTables();
+        std::vector<SongTable> songTables = ScanCache::Instance().ScanForTables();
         std::cout << "Found " << songTables.size() << " Songtable(s)." << std::endl;
         if (songTableIndex >= songTables.size()) {
           throw Xcept("Songtable index out of range");
@@ -89,11 +144,17 @@ int main(int argc, char *argv[])
 }
 
 static void usage() {
-    std::cout << "Usage: ./agbplay <ROM.gba> [table number]" << std::endl;
+    std::cout << "Usage: ./agbplay [options] <ROM.gba> [table number]" << std::endl;
+    std::cout << "       ./agbplay --export <ROM.gba> [table number] [options] (see --help)" << std::endl;
 }
 
 static void help() {
     usage();
+    std::cout << "\nOptions:\n"
+        "  --samplerate <Hz>: Output sample rate for playback and export (default 48000)\n"
+        "  --buffer-size <samples>: Size of the playback buffer (default and minimum depend on the sample rate)\n"
+        "  --help: Show this help\n\n";
+    ExportCLI::Usage();
     std::cout << "\nControls:\n"
         "  - Arrow Keys or HJKL: Navigate through the program\n"
         "  - Tab: Change between Playlist and Songlist\n"
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "ConfigManager.h"
+#include "SoundExporter.h"
+#include "SongEntry.h"
+#include "SoundData.h"
+#include "Constants.h"
+#include "Rom.h"
+
+/*
+ * Streams two songs of the synthetic ROM (tests/fixtures/mkfixture.py) with a
+ * crossfade and checks that the level stays flat while one fades into the
+ * other. Both songs are a single held note at a constant level, so every
+ * window from the start of the first song to the fade out of the second
+ * should be within the solo levels of the two, give or take a little.
+ */
+
+#define FIXTURE_ROM "tests/fixtures/synthetic.gba"
+
+#define SAMPLE_RATE 48000
+#define FIRST_SONG 5
+#define SECOND_SONG 6
+#define CROSSFADE_SECONDS 2.0
+#define WINDOW_SIZE 960                 // 20 ms
+#define SKIP_SECONDS 0.25               // attack at the start, fade out at the end
+
+#define MAX_DEVIATION_DB 1.0
+
+static double windowDb(const std::vector<sample>& samples, size_t start)
+{
+    double sumSquares = 0.0;
+    for (size_t i = start; i < start + WINDOW_SIZE; i++) {
+        sumSquares += double(samples[i].left) * double(samples[i].left);
+        sumSquares += double(samples[i].right) * double(samples[i].right);
+    }
+    return 10.0 * log10(sumSquares / double(2 * WINDOW_SIZE) + 1e-20);
+}
+
+int main()
+{
+    const std::filesystem::path streamPath = std::filesystem::temp_directory_path() / "agbplay-crossfade-test.f32";
+
+    try {
+        Rom::CreateInstance(FIXTURE_ROM);
+        ConfigManager& cm = ConfigManager::Instance();
+        // only what the engine and the stream use, the user's configuration must not affect the test
+        cm.SetGameCode(Rom::Instance().GetROMCode());
+        cm.SetCgbPolyphony(CGBPolyphony::MONO_STRICT);
+        cm.SetMaxLoopsExport(0);
+        cm.SetSampleRate(SAMPLE_RATE);
+        cm.SetPadSecondsStart(0.0);
+        cm.SetPadSecondsEnd(0.0);
+        cm.SetExportCache(false);
+
+        std::vector<SongTable> songTables = SongTable::ScanForTables();
+        if (songTables.empty() || songTables[0].GetNumSongs() <= SECOND_SONG) {
+            printf("crossfade: no song table found in %s\n", FIXTURE_ROM);
+            return EXIT_FAILURE;
+        }
+
+        SoundExporter exporter(songTables[0], std::filesystem::temp_directory_path(), false, false, 1);
+        exporter.SetStream(streamPath.string(), RawFormat::F32, false);
+        exporter.SetCrossfade(CROSSFADE_SECONDS);
+        exporter.Export({SongEntry("first", FIRST_SONG), SongEntry("second", SECOND_SONG)});
+    } catch (const std::exception& e) {
+        printf("crossfade: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<sample> samples(std::filesystem::file_size(streamPath) / sizeof(sample));
+    {
+        std::ifstream file(streamPath, std::ios::binary);
+        file.read(reinterpret_cast<char *>(samples.data()), std::streamsize(samples.size() * sizeof(sample)));
+    }
+    std::filesystem::remove(streamPath);
+
+    const size_t skip = size_t(SKIP_SECONDS * SAMPLE_RATE);
+    const size_t fadeOut = size_t(SONG_FADE_OUT_TIME / 1000.0 * SAMPLE_RATE);
+    if (samples.size() < 2 * skip + fadeOut + WINDOW_SIZE) {
+        printf("crossfade: only %zu samples written FAILED\n", samples.size());
+        return EXIT_FAILURE;
+    }
+    const size_t end = samples.size() - fadeOut - skip - WINDOW_SIZE;
+
+    // the first and last window before the fade out are each song on its own
+    const double firstDb = windowDb(samples, skip);
+    const double secondDb = windowDb(samples, end);
+    const double low = std::min(firstDb, secondDb) - MAX_DEVIATION_DB;
+    const double high = std::max(firstDb, secondDb) + MAX_DEVIATION_DB;
+
+    double minDb = INFINITY;
+    double maxDb = -INFINITY;
+    for (size_t start = skip; start <= end; start += WINDOW_SIZE) {
+        const double db = windowDb(samples, start);
+        minDb = std::min(minDb, db);
+        maxDb = std::max(maxDb, db);
+    }
+    const bool passed = minDb >= low && maxDb <= high;
+    printf("crossfade: solo levels %.2f dB and %.2f dB, %.2f dB to %.2f dB across the overlap (limit %.2f dB to %.2f dB) %s\n",
+            firstDb, secondDb, minDb, maxDb, low, high, passed ? "ok" : "FAILED");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
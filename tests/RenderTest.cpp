@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ConfigManager.h"
+#include "PlayerContext.h"
+#include "SoundData.h"
+#include "Constants.h"
+#include "Rom.h"
+
+/*
+ * Renders the songs of a synthetic ROM (generated by tests/fixtures/mkfixture.py)
+ * with every resampler and every reverb type and compares the output with a
+ * stored reference. The vectorized code paths differ between CPUs in the last
+ * bits, so the comparison allows a small error instead of requiring equal
+ * samples. After an intended change of the output, the reference is written
+ * again with "obj/tests/RenderTest --update".
+ *
+ * To keep the reference small, only a window at the start of every quarter
+ * second is kept.
+ */
+
+#define FIXTURE_ROM "tests/fixtures/synthetic.gba"
+#define FIXTURE_REFERENCE "tests/fixtures/synthetic.ref"
+#define REFERENCE_MAGIC "agbplay render reference 1\n"
+
+#define SAMPLE_RATE 48000
+#define RENDER_SONGS 4                  // the last song of the fixture is empty
+#define RENDER_CHUNKS 8                 // of a quarter second each
+#define WINDOW_SIZE 128
+
+#define MAX_ABS_ERROR 1e-4
+#define MIN_SNR_DB 90.0
+
+struct Setup
+{
+    std::string name;
+    ResamplerType resType;
+    ReverbType revType;
+};
+
+static std::vector<Setup> getSetups()
+{
+    const ResamplerType resTypes[] = {
+        ResamplerType::NEAREST, ResamplerType::LINEAR, ResamplerType::SINC, ResamplerType::BLEP, ResamplerType::BLAMP,
+    };
+    const ReverbType revTypes[] = {
+        ReverbType::GS1, ReverbType::GS2, ReverbType::MGAT, ReverbType::TEST, ReverbType::NONE,
+    };
+
+    // every resampler with the default reverb and every other reverb with the default resampler
+    std::vector<Setup> setups;
+    for (ResamplerType res : resTypes)
+        setups.push_back(Setup{res2str(res) + "/" + rev2str(ReverbType::NORMAL), res, ReverbType::NORMAL});
+    for (ReverbType rev : revTypes)
+        setups.push_back(Setup{res2str(ResamplerType::LINEAR) + "/" + rev2str(rev), ResamplerType::LINEAR, rev});
+    return setups;
+}
+
+static std::vector<sample> render(SongTable& songTable, const Setup& setup)
+{
+    GameConfig& cfg = ConfigManager::Instance().GetCfg();
+    cfg.SetResType(setup.resType);
+    cfg.SetResTypeFixed(setup.resType);
+    cfg.SetRevType(setup.revType);
+
+    const size_t chunkMicroframes = AGB_FPS * INTERFRAMES / 4;
+    std::vector<std::vector<sample>> trackAudio;
+    std::vector<sample> windows;
+    for (uint16_t uid = 0; uid < RENDER_SONGS; uid++) {
+        PlayerContext ctx(
+                1,
+                cfg.GetTrackLimit(),
+                EnginePars(cfg.GetPCMVol(), cfg.GetEngineRev(), cfg.GetEngineFreq()),
+                SAMPLE_RATE
+                );
+        ctx.InitSong(songTable.GetPosOfSong(uid));
+        for (size_t chunk = 0; chunk < RENDER_CHUNKS; chunk++) {
+            const size_t n = ctx.Render(trackAudio, chunkMicroframes);
+            std::vector<sample> window(WINDOW_SIZE, sample{0.0f, 0.0f});
+            for (const std::vector<sample>& b : trackAudio) {
+                for (size_t i = 0; i < std::min<size_t>(n, WINDOW_SIZE); i++) {
+                    window[i].left += b[i].left;
+                    window[i].right += b[i].right;
+                }
+            }
+            windows.insert(windows.end(), window.begin(), window.end());
+        }
+    }
+    return windows;
+}
+
+/*
+ * The reference file is the magic line followed by one record per setup:
+ * the name, a newline, the number of samples as uint32_t and the samples as
+ * pairs of floats, both in native byte order.
+ */
+static bool readReference(std::map<std::string, std::vector<sample>>& reference)
+{
+    std::ifstream file(FIXTURE_REFERENCE, std::ios::binary);
+    std::string line;
+    if (!std::getline(file, line) || line + "\n" != REFERENCE_MAGIC)
+        return false;
+    while (std::getline(file, line)) {
+        uint32_t count;
+        if (!file.read(reinterpret_cast<char *>(&count), sizeof(count)))
+            return false;
+        std::vector<sample>& samples = reference[line];
+        samples.resize(count);
+        if (!file.read(reinterpret_cast<char *>(samples.data()), std::streamsize(count * sizeof(sample))))
+            return false;
+    }
+    return true;
+}
+
+static bool writeReference(const std::map<std::string, std::vector<sample>>& reference)
+{
+    std::ofstream file(FIXTURE_REFERENCE, std::ios::binary | std::ios::trunc);
+    file << REFERENCE_MAGIC;
+    for (const auto& [name, samples] : reference) {
+        const uint32_t count = static_cast<uint32_t>(samples.size());
+        file << name << "\n";
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char *>(samples.data()), std::streamsize(count * sizeof(sample)));
+    }
+    return file.good();
+}
+
+static bool compare(const std::string& name, const std::vector<sample>& actual, const std::vector<sample>& expected)
+{
+    if (actual.size() != expected.size()) {
+        printf("render %-14s: %zu samples instead of %zu FAILED\n", name.c_str(), actual.size(), expected.size());
+        return false;
+    }
+    double maxError = 0.0;
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t i = 0; i < actual.size(); i++) {
+        const double errors[2] = {
+            double(actual[i].left) - double(expected[i].left),
+            double(actual[i].right) - double(expected[i].right),
+        };
+        for (double e : errors) {
+            maxError = std::max(maxError, std::fabs(e));
+            noise += e * e;
+        }
+        signal += double(expected[i].left) * double(expected[i].left);
+        signal += double(expected[i].right) * double(expected[i].right);
+    }
+    const double snr = noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY;
+    const bool passed = maxError <= MAX_ABS_ERROR && snr >= MIN_SNR_DB;
+    printf("render %-14s: max abs error %.3g (limit %.3g), SNR %.1f dB (limit %.1f dB) %s\n",
+            name.c_str(), maxError, MAX_ABS_ERROR, snr, MIN_SNR_DB, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool update = argc > 1 && !strcmp(argv[1], "--update");
+
+    try {
+        Rom::CreateInstance(FIXTURE_ROM);
+        ConfigManager& cm = ConfigManager::Instance();
+        // only what the engine uses, the user's configuration must not affect the test
+        cm.SetGameCode(Rom::Instance().GetROMCode());
+        cm.SetCgbPolyphony(CGBPolyphony::MONO_STRICT);
+        cm.SetMaxLoopsExport(1);
+        cm.SetSampleRate(SAMPLE_RATE);
+
+        std::vector<SongTable> songTables = SongTable::ScanForTables();
+        if (songTables.empty() || songTables[0].GetNumSongs() < RENDER_SONGS) {
+            printf("render: no song table found in %s\n", FIXTURE_ROM);
+            return EXIT_FAILURE;
+        }
+
+        std::map<std::string, std::vector<sample>> reference;
+        if (!update && !readReference(reference)) {
+            printf("render: couldn't read %s, create it with --update\n", FIXTURE_REFERENCE);
+            return EXIT_FAILURE;
+        }
+
+        bool ok = true;
+        for (const Setup& setup : getSetups()) {
+            std::vector<sample> actual = render(songTables[0], setup);
+            if (update) {
+                reference[setup.name] = std::move(actual);
+                continue;
+            }
+            auto expected = reference.find(setup.name);
+            if (expected == reference.end()) {
+                printf("render %-14s: no reference FAILED\n", setup.name.c_str());
+                ok = false;
+                continue;
+            }
+            ok = compare(setup.name, actual, expected->second) && ok;
+        }
+
+        if (update) {
+            if (!writeReference(reference)) {
+                printf("render: writing %s failed\n", FIXTURE_REFERENCE);
+                return EXIT_FAILURE;
+            }
+            printf("render: wrote %zu setups to %s\n", reference.size(), FIXTURE_REFERENCE);
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& e) {
+        printf("render: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+}
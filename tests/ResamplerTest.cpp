@@ -0,0 +1,126 @@
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Resampler.h"
+
+/*
+ * Checks the convolution kernels of the polyphase resamplers:
+ * - every vectorized implementation this CPU supports against the scalar one
+ * - the polyphase banks against evaluating the kernel function directly
+ */
+
+#define TAPS (SINC_WINDOW_SIZE * 2)
+// the implementations only differ in summation order
+#define SIMD_MAX_ABS_ERROR 2e-6
+// error of interpolating between phases, relative to the direct evaluation
+#define POLYPHASE_MIN_SNR_DB 75.0
+
+static bool testConvolveImpls()
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> fractionDist(0.0f, 1.0f);
+
+    std::vector<PolyphaseBank::ConvolveImpl> impls = PolyphaseBank::GetConvolveImpls();
+    std::vector<float> kernels(TAPS * 2);
+    // the window starts at varying offsets so unaligned loads get tested
+    std::vector<float> data(TAPS + 3);
+    bool ok = true;
+
+    for (size_t i = 1; i < impls.size(); i++) {
+        double maxError = 0.0;
+        for (int n = 0; n < 100000; n++) {
+            // like the banks, each kernel is normalized to a sum of magnitudes of 1
+            for (size_t k = 0; k < 2; k++) {
+                float sum = 0.0f;
+                for (size_t t = 0; t < TAPS; t++) {
+                    kernels[k * TAPS + t] = dist(rng);
+                    sum += fabsf(kernels[k * TAPS + t]);
+                }
+                for (size_t t = 0; t < TAPS; t++)
+                    kernels[k * TAPS + t] /= sum;
+            }
+            for (float& d : data)
+                d = dist(rng);
+            const float *window = &data[n % 4];
+            float fraction = fractionDist(rng);
+
+            float expected = impls[0].func(kernels.data(), window, fraction);
+            float actual = impls[i].func(kernels.data(), window, fraction);
+            maxError = std::max(maxError, std::fabs(double(actual) - double(expected)));
+        }
+        bool passed = maxError <= SIMD_MAX_ABS_ERROR;
+        printf("convolve %-6s vs scalar: max abs error %.3g (limit %.3g) %s\n",
+                impls[i].name, maxError, SIMD_MAX_ABS_ERROR, passed ? "ok" : "FAILED");
+        ok = ok && passed;
+    }
+    if (impls.size() == 1)
+        printf("convolve: no vectorized implementation on this CPU\n");
+    return ok;
+}
+
+static bool testPolyphaseBanks()
+{
+    const struct {
+        const char *name;
+        ResamplerType type;
+        float minSincStep;
+        float maxSincStep;
+    } kernels[] = {
+        {"sinc", ResamplerType::SINC, 1.0f / 32.0f, 1.0f},
+        {"blep", ResamplerType::BLEP, 1.0f / 32.0f, 16.0f},
+        {"blamp", ResamplerType::BLAMP, 1.0f / 32.0f, 16.0f},
+    };
+
+    std::mt19937 rng(5678);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> phaseDist(0.0f, 1.0f);
+    std::vector<float> data(TAPS);
+    bool ok = true;
+
+    for (const auto& k : kernels) {
+        PolyphaseBankSet& banks = PolyphaseBankSet::Get(k.type);
+        double worstSnr = INFINITY;
+        float worstSincStep = 0.0f;
+        // steps of a bit more than a band, so the position within the band varies
+        for (float sincStep = k.minSincStep; sincStep <= k.maxSincStep; sincStep *= 1.0183f) {
+            int band;
+            float fraction;
+            PolyphaseBankSet::GetBand(sincStep, band, fraction);
+            std::unique_ptr<PolyphaseBank> bank = banks.Compute(band);
+
+            double signal = 0.0;
+            double noise = 0.0;
+            for (int n = 0; n < 2000; n++) {
+                for (float& d : data)
+                    d = dist(rng);
+                float phase = phaseDist(rng);
+                double expected = bank->ConvolveDirect(data.data(), phase);
+                double actual = bank->Convolve(data.data(), phase);
+                signal += expected * expected;
+                noise += (actual - expected) * (actual - expected);
+            }
+            double snr = noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY;
+            if (snr < worstSnr) {
+                worstSnr = snr;
+                worstSincStep = sincStep;
+            }
+        }
+        bool passed = worstSnr >= POLYPHASE_MIN_SNR_DB;
+        printf("polyphase %-5s vs direct: worst SNR %.1f dB at sincStep %.4f (limit %.1f dB) %s\n",
+                k.name, worstSnr, double(worstSincStep), POLYPHASE_MIN_SNR_DB, passed ? "ok" : "FAILED");
+        ok = ok && passed;
+    }
+    return ok;
+}
+
+int main()
+{
+    bool ok = testConvolveImpls();
+    ok = testPolyphaseBanks() && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+
+# Generates synthetic.gba, a small ROM with an mp2k (Sappy) sound engine song
+# table for the render regression test (tests/RenderTest.cpp). It covers PCM
+# (looped, one-shot, fixed rate, compressed), GS synths, all CGB channels,
+# drum kits, key splits, modulation, pitch bends and reverb, plus two steady
+# tones for the crossfade test (tests/CrossfadeTest.cpp). The output only
+# depends on this script, so the ROM can be regenerated at any time:
+#
+#   python3 tests/fixtures/mkfixture.py
+#
+# Changing the songs requires updating the reference with
+# "obj/tests/RenderTest --update" as well.
+
+import os
+import sys
+import struct
+import math
+import random
+
+# fixed seed, so the noise samples are the same every time
+random.seed(1234)
+
+# cartridge header, checked by Rom::verify()
+LOGO = bytes([
+0x24,0xff,0xae,0x51,0x69,0x9a,0xa2,0x21,0x3d,0x84,0x82,0x0a,0x84,0xe4,0x09,0xad,
+0x11,0x24,0x8b,0x98,0xc0,0x81,0x7f,0x21,0xa3,0x52,0xbe,0x19,0x93,0x09,0xce,0x20,
+0x10,0x46,0x4a,0x4a,0xf8,0x27,0x31,0xec,0x58,0xc7,0xe8,0x33,0x82,0xe3,0xce,0xbf,
+0x85,0xf4,0xdf,0x94,0xce,0x4b,0x09,0xc1,0x94,0x56,0x8a,0xc0,0x13,0x72,0xa7,0xfc,
+0x9f,0x84,0x4d,0x73,0xa3,0xca,0x9a,0x61,0x58,0x97,0xa3,0x27,0xfc,0x03,0x98,0x76,
+0x23,0x1d,0xc7,0x61,0x03,0x04,0xae,0x56,0xbf,0x38,0x84,0x00,0x40,0xa7,0x0e,0xfd,
+0xff,0x52,0xfe,0x03,0x6f,0x95,0x30,0xf1,0x97,0xfb,0xc0,0x85,0x60,0xd6,0x80,0x25,
+0xa9,0x63,0xbe,0x03,0x01,0x4e,0x38,0xe2,0xf9,0xa2,0x34,0xff,0xbb,0x3e,0x03,0x44,
+0x78,0x00,0x90,0xcb,0x88,0x11,0x3a,0x94,0x65,0xc0,0x7c,0x63,0x87,0xf0,0x3c,0xaf,
+0xd6,0x25,0xe4,0x8b,0x38,0x0a,0xac,0x72,0x21,0xd4,0xf8,0x07])
+rom = bytearray(0x200)
+rom[4:4+len(LOGO)] = LOGO
+rom[0xA0:0xAC] = b'AGBPLAYTEST\0'
+rom[0xAC:0xB0] = b'ZZTE'
+rom[0xB2] = 0x96
+chk = 0
+for i in range(0xA0, 0xBD): chk -= rom[i]
+rom[0xBD] = (chk - 0x19) & 0xFF
+
+# everything is appended to the ROM, pointers are GBA addresses
+def align():
+    while len(rom) % 4: rom.append(0)
+def here(): return 0x08000000 + len(rom)
+def put(b):
+    align(); p = here(); rom.extend(b); return p
+def u32(v): return struct.pack('<I', v)
+# samples
+def sample(data, freq, loop=True, loopPos=0, end=None, hdr=0):
+    end = len(data) if end is None else end
+    b = bytes([hdr,0,0,0x40 if loop else 0]) + u32(int(freq*1024)) + u32(loopPos) + u32(end) + bytes((x & 0xFF) for x in data)
+    return put(b)
+saw = [int(100*math.sin(2*math.pi*i/64) + 20*math.sin(2*math.pi*i*3/64)) for i in range(64)]
+smp_loop = sample(saw*8, 8363*8, True, 0)
+noise = [random.randint(-120,120)*(2000-i)//2000 for i in range(2000)]
+smp_drum = sample(noise, 13379, False)
+pluck = [int(110*math.exp(-i/600)*math.sin(2*math.pi*i/37)) for i in range(3000)]
+smp_pluck = sample(pluck, 22050, False)
+# MPT compressed: negative length; data nibbles
+mpt = bytes(random.randint(0,255) for _ in range(800))
+smp_mpt = put(bytes([0,0,0,0]) + u32(int(13379*1024)) + u32(0) + u32((-1600) & 0xFFFFFFFF) + mpt)
+# GS synth: loop, loopPos 0, endPos 0; samplePtr[1] = type, 2..5 params
+gs_pulse = put(bytes([0,0,0,0x40]) + u32(int(440*1024)) + u32(0) + u32(0) + bytes([0,0,0x40,0x10,0x60,0x20,0,0]))
+gs_saw = put(bytes([0,0,0,0x40]) + u32(int(440*1024)) + u32(0) + u32(0) + bytes([0,1,0,0,0,0,0,0]))
+gs_tri = put(bytes([0,0,0,0x40]) + u32(int(440*1024)) + u32(0) + u32(0) + bytes([0,2,0,0,0,0,0,0]))
+wave = put(bytes([0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,0xFE,0xDC,0xBA,0x98,0x76,0x54,0x32,0x10]))
+def vpcm(smp, fixed=False, key=60, pan=0, adsr=(255,0,255,0)):
+    return bytes([8 if fixed else 0, key, 0, pan]) + u32(smp) + bytes(adsr)
+def vsq(t, duty, sweep=0, adsr=(0,2,10,3)):
+    return bytes([t, 60, 0, sweep]) + u32(duty) + bytes(adsr)
+def vwave(adsr=(0,1,12,2)):
+    return bytes([3, 60, 0, 0]) + u32(wave) + bytes(adsr)
+def vnoise(p, adsr=(0,3,0,0)):
+    return bytes([4, 60, 0, 0]) + u32(p) + bytes(adsr)
+# drumkit sub bank (128 entries)
+dk = bytearray()
+for k in range(128):
+    if k % 3 == 0: dk += vpcm(smp_drum, True, 60, 0x80 + (k % 60), (255,200,0,150))
+    elif k % 3 == 1: dk += vnoise(k % 2, (0,2,0,0))
+    else: dk += vpcm(smp_pluck, False, k, 0xC0, (255,250,100,200))
+dk_ptr = put(bytes(dk))
+# keysplit
+ks_sub = put(vpcm(smp_loop, False, 60, 0, (255,240,180,220)) + vpcm(smp_pluck, False, 60, 0, (200,250,150,230)))
+ks_map = put(bytes([0 if k < 60 else 1 for k in range(128)]))
+voices = [
+    vpcm(smp_loop, False, 60, 0, (255,240,200,230)),          # 0 pcm loop
+    vpcm(smp_pluck, False, 60, 0, (255,250,120,200)),         # 1 pcm one-shot
+    vpcm(smp_drum, True, 60, 0, (255,0,255,165)),             # 2 fixed pcm
+    vsq(1, 2, 0x00),                                          # 3 sq1
+    vsq(1, 1, 0x17, (0,0,15,0)),                              # 4 sq1 sweep
+    vsq(2, 0, 0, (1,3,8,4)),                                  # 5 sq2
+    vwave(),                                                  # 6 wave
+    vnoise(0),                                                # 7 noise
+    bytes([0x80,0,0,0]) + u32(dk_ptr) + u32(0),               # 8 drumkit
+    bytes([0x40,0,0,0]) + u32(ks_sub) + u32(ks_map),          # 9 keysplit
+    vpcm(smp_mpt, False, 60, 0, (255,0,255,200)),             # 10 mpt compressed
+    vpcm(gs_pulse, False, 60, 0, (255,0,255,200)),            # 11 gs pulse
+    vpcm(gs_saw, False, 60, 0, (255,0,255,200)),              # 12 gs saw
+    vpcm(gs_tri, False, 60, 0, (255,0,255,200)),              # 13 gs tri
+    vpcm(smp_loop, False, 60, 0, (255,0,255,0)),              # 14 pcm loop, no envelope
+]
+vg = put(b''.join(voices) + bytes(12*(128-len(voices))))
+# track builder
+def note(len_cmd, key, vel, extra=None):
+    b = bytes([len_cmd, key, vel])
+    if extra is not None: b += bytes([extra])
+    return b
+W = lambda n: bytes([0x80 + n]) if n <= 24 else bytes([0x98])
+def track(body, loop=True, tempo=None, intro=b''):
+    head = b''
+    if tempo: head += bytes([0xBB, tempo])
+    head += intro
+    start_off = len(head)
+    # emit into rom with GOTO back to start
+    align()
+    p = here()
+    b = head + body
+    if loop:
+        b += bytes([0xB2]) + u32(p + start_off)
+    b += bytes([0xB1])
+    rom.extend(b)
+    return p
+def song(tracks, rev=0, prio=0):
+    align()
+    p = here()
+    rom.extend(bytes([len(tracks), 0, prio, rev]) + u32(vg) + b''.join(u32(t) for t in tracks))
+    return p
+songs = []
+# song 0: pcm melody with bends + vibrato, chord, reverb
+t0 = track(bytes([0xBD,0,0xBE,100,0xBF,0x40,0xC1,12,0xC2,30,0xC4,40]) +
+    b''.join(note(0xD7, 48 + (i*5)%24, 100 - i*3) + bytes([0xC0, 0x40 + (i*7)%40]) + W(12) for i in range(16)), True, 75)
+t1 = track(bytes([0xBD,1,0xBE,90,0xBF,0x20]) + b''.join(note(0xDF, 60+(i%5)*2, 120) + W(24) for i in range(8)))
+t2 = track(bytes([0xBD,8,0xBE,110]) + b''.join(bytes([0xD3, (i*7)%128, 127]) + W(6) for i in range(40)))
+songs.append(song([t0,t1,t2], rev=0x80|40))
+# song 1: CGB only, square sweep, wave, noise, polyphony
+t0 = track(bytes([0xBD,3,0xBE,120]) + b''.join(note(0xDB, 60+i, 100) + W(8) for i in range(12)), True, 90)
+t1 = track(bytes([0xBD,4,0xBE,100,0xBF,0x10]) + b''.join(note(0xE7, 72-i, 127) + W(24) for i in range(6)))
+t2 = track(bytes([0xBD,6,0xBE,127,0xC4,60,0xC5,0]) + b''.join(note(0xEF, 48+i*2, 110) + W(24) for i in range(6)))
+t3 = track(bytes([0xBD,7,0xBE,80]) + b''.join(note(0xD1, 50 + i*3, 127) + W(4) for i in range(30)))
+t4 = track(bytes([0xBD,5,0xBE,100,0xBF,0x70]) + b''.join(note(0xDF, 65+(i%3), 90) + W(12) for i in range(12)))
+songs.append(song([t0,t1,t2,t3,t4]))
+# song 2: fixed pcm, keysplit, mpt, gs synths, EOT ties, ends (no loop)
+t0 = track(bytes([0xBD,2,0xBE,127]) + b''.join(note(0xD3, 60, 127) + W(12) for i in range(20)), False, 60)
+t1 = track(bytes([0xBD,9,0xBE,100]) + b''.join(bytes([0xCF, 50 + i*3, 100]) + W(18) + bytes([0xCE, 50+i*3]) for i in range(8)), False)
+t2 = track(bytes([0xBD,10,0xBE,120]) + note(0xEF, 60, 127) + W(24)*2, False)
+t3 = track(bytes([0xBD,11,0xBE,90]) + note(0xFF, 57, 100) + W(24)*4 + bytes([0xBD,12]) + note(0xF3, 64, 100) + W(24)*3 + bytes([0xBD,13]) + note(0xF3, 69, 100) + W(24)*3, False)
+songs.append(song([t0,t1,t2,t3], rev=0x80|20))
+# song 3: dense 10 track pcm stress, fast tempo
+ts = []
+for k in range(10):
+    ts.append(track(bytes([0xBD, [0,1,8,9][k%4], 0xBE, 70, 0xBF, 0x40 + (k-5)*8, 0xC1, 2, 0xC2, 20+k, 0xC4, 10+k*3]) +
+        b''.join(note(0xD0 + (i+k)%16, 36 + (i*11+k*7)%60, 80+(i%40)) + W(3 + (i+k)%5) for i in range(60)), True, 160 if k == 0 else None))
+songs.append(song(ts, rev=0x80|30))
+# song 4: empty song
+align(); p = here(); rom.extend(bytes(8)); songs.append(p)
+# songs 5 and 6: one tied note each at a constant level, looping after 192 ticks
+for key in (60, 67):
+    t0 = track(W(24)*8, True, 75, bytes([0xBD,14,0xBE,100,0xCF,key,127]))
+    songs.append(song([t0]))
+# song table + reference
+align()
+table = here()
+for s in songs:
+    rom.extend(u32(s) + bytes([0,0,0,0]))
+rom.extend(bytes(8))
+rom.extend(u32(table))  # reference to the song table
+while len(rom) % 0x1000: rom.append(0)
+out = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), 'synthetic.gba')
+with open(out, 'wb') as f:
+    f.write(rom)
+print('%s: %d songs, song table at %#x' % (out, len(songs), table))